@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class DNSMessage;
+
+// Defines every error returned while compiling a filter expression
+enum filterError { FILTER_VALID, FILTER_SYNTAX_ERROR, FILTER_FIELD_ERROR, FILTER_VALUE_ERROR, FILTER_DEPTH_ERROR };
+
+// Message fields that can be tested by a filter expression
+enum filterField {
+    FIELD_ID, FIELD_QR, FIELD_OPCODE, FIELD_AA, FIELD_TC, FIELD_RD, FIELD_RA, FIELD_Z, FIELD_RCODE,
+    FIELD_QDCOUNT, FIELD_ANCOUNT, FIELD_NSCOUNT, FIELD_ARCOUNT,
+    FIELD_QNAME, FIELD_QTYPE, FIELD_QCLASS
+};
+
+// Operations of a compiled predicate program, evaluated as postfix on a stack of booleans
+enum filterOpcode { OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE, OP_SUFFIX, OP_AND, OP_OR, OP_NOT };
+
+// Single step of a compiled predicate program
+struct FilterInstruction {
+    filterOpcode op;
+    filterField field;
+    unsigned int value;
+    string name;
+};
+
+// Compiles a filter expression once and tests parsed messages against it
+// Example: "rcode=NXDOMAIN && (qtype=AAAA || tc)" or "qname~=example.com && !qr"
+class DNSFilter {
+    public:
+        DNSFilter();
+
+        filterError compile(string expression);
+        bool matches(DNSMessage& message) const;
+        bool needsQuestions() const;
+        bool empty() const;
+
+    private:
+        // Deepest boolean stack a program may need during evaluation
+        static const int maxStackDepth = 64;
+        // Deepest nesting of '!' and parentheses accepted by the recursive parser
+        static const int maxNestingDepth = 256;
+
+        vector<FilterInstruction> program;
+        bool questionFields;
+
+        vector<string> tokens;
+        int tokenPos;
+        int stackDepth;
+        int maxDepth;
+        int nestingDepth;
+
+        filterError tokenize(string& expression);
+        filterError parseOr();
+        filterError parseAnd();
+        filterError parseUnary();
+        filterError parseComparison();
+        filterError parseValue(filterField field, string value, FilterInstruction& instruction);
+        void emit(FilterInstruction instruction);
+
+        bool testField(const FilterInstruction& instruction, DNSMessage& message) const;
+        bool compareValue(filterOpcode op, unsigned int left, unsigned int right) const;
+        bool compareName(filterOpcode op, const string& qName, const string& filterName) const;
+};
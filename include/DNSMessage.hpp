@@ -1,8 +1,15 @@
+#pragma once
+
 #include <string>
 #include <vector>
+#include <InputDecoder.hpp>
 
 using namespace std;
 
+class DNSFilter;
+class SuffixMatcher;
+class MessageCache;
+
 
 // Defines every error thrown during DNS name validation
 enum dnsNameError { VALID, INVALID_NAME_ERROR, NUMERIC_NAME_ERROR, INVALID_CHAR_ERROR };
@@ -36,13 +43,64 @@ struct ResourceRecord {
     string rData;
 };
 
+// Optional behaviour applied while a message is being parsed
+struct DNSParseOptions {
+    // Messages rejected by the filter skip resource record decoding and formatting
+    const DNSFilter* filter;
+
+    // Questions are parsed even for messages a header-only filter rejects
+    bool alwaysParseQuestions;
+
+    // Names in the message are tagged when they fall under an entry of the suffix list
+    const SuffixMatcher* matcher;
+
+    // Repeated messages (ignoring ID and TTLs) are copied from the cache instead of parsed
+    MessageCache* cache;
+
+    // Encoding of the input, detected from each message when left as FORMAT_AUTO
+    inputFormat format;
+
+    // Messages that fail to decode in the detected hex format of the stream are decoded as the other hex format
+    bool mixedFormats;
+};
+
+// Defines a name found under an entry of the suffix list
+struct SuffixMatch {
+    string name;
+    string suffix;
+};
+
 // Stores all DNS Message data and allows printing of the data
 class DNSMessage {
     public:
         DNSMessage();
         DNSMessage(string hexData);
+        DNSMessage(string hexData, const DNSParseOptions& options);
+        DNSMessage(const unsigned char* wireData, size_t length, const DNSParseOptions& options);
         
         void printData();
+
+        unsigned int getID();
+        DNSFlags getFlags();
+        unsigned int getQDCount();
+        unsigned int getANCount();
+        unsigned int getNSCount();
+        unsigned int getARCount();
+        const vector<DNSQuestion>& getQuestions();
+        const vector<ResourceRecord>& getAnswers();
+        const vector<ResourceRecord>& getAuthority();
+        const vector<ResourceRecord>& getAdditional();
+        const vector<SuffixMatch>& getSuffixMatches();
+
+        bool isFiltered();
+        bool isCached();
+        unsigned int getSkippedBytes();
+        size_t getMemoryUsage();
+
+        static string typeName(unsigned int type);
+        static string className(unsigned int rClass);
+        static string rcodeName(unsigned int rcode);
+        static string printableRecord(const ResourceRecord& record);
         
     private:
         unsigned int dnsID;
@@ -57,6 +115,19 @@ class DNSMessage {
         vector<ResourceRecord> authority;
         vector<ResourceRecord> additional;
 
+        vector<SuffixMatch> suffixMatches;
+
+        const SuffixMatcher* matcher;
+        bool filtered;
+        bool cached;
+        unsigned int skippedBytes;
+
+        void parse(string& hexData, const DNSParseOptions& options);
+        void parseDecoded(string& hexData, const DNSParseOptions& options);
+        void skipRemaining(string& hexData, int begin);
+        bool buildCacheKey(string& hexData, string& key, vector<int>& ttlOffsets, int& recordsBegin);
+        void patchCachedMessage(string& hexData, vector<int>& ttlOffsets);
+        int skipName(string& hexData, int begin);
         void parseHeader(string& hexData, int& begin);
         void parseQuestions(string& hexData, int& begin);
         void parseResourceRecords(string& hexData, int& begin);
@@ -64,9 +135,11 @@ class DNSMessage {
         string printableHeader();
         string printableQuestions();
         string printableResourceRecords();
+        string printableSuffixMatches();
 
         void parseRRData(string& hexData, int& begin, ResourceRecord& dataRecord);
-        int extractRawHex(string& hexString);
+        int extractRawHex(string& hexString, const DNSParseOptions& options);
         string extractName(string& hexData, int& begin);
+        void matchName(string& hexData, int nameStart, string& name);
         dnsNameError validateName(string dnsName);
 };
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <MappedFile.hpp>
+
+using namespace std;
+
+// Defines every error found while reading a dnstap stream
+enum dnstapError { DNSTAP_VALID, DNSTAP_IO, DNSTAP_FRAME, DNSTAP_CONTROL, DNSTAP_CONTENT_TYPE, DNSTAP_PROTOBUF };
+
+// Frame Streams control frame types
+enum dnstapControl { CONTROL_ACCEPT = 1, CONTROL_START = 2, CONTROL_STOP = 3, CONTROL_READY = 4, CONTROL_FINISH = 5 };
+
+// Message types of dnstap.Message - odd types are queries, even types responses
+enum dnstapMessageType {
+    AUTH_QUERY = 1, AUTH_RESPONSE, RESOLVER_QUERY, RESOLVER_RESPONSE, CLIENT_QUERY, CLIENT_RESPONSE,
+    FORWARDER_QUERY, FORWARDER_RESPONSE, STUB_QUERY, STUB_RESPONSE, TOOL_QUERY, TOOL_RESPONSE,
+    UPDATE_QUERY, UPDATE_RESPONSE
+};
+
+// Fields of a single dnstap.Message (times in nanoseconds since the epoch)
+// The wire messages point into the mapped file or the frame buffer and are valid until the next frame is read
+struct DnstapMessage {
+    unsigned int type;
+    unsigned int socketFamily;
+    unsigned int socketProtocol;
+    string queryAddress;
+    string responseAddress;
+    unsigned int queryPort;
+    unsigned int responsePort;
+    uint64_t queryTime;
+    uint64_t responseTime;
+    const unsigned char* queryMessage;
+    size_t queryLength;
+    const unsigned char* responseMessage;
+    size_t responseLength;
+};
+
+// Reads dnstap messages from a Frame Streams file, or from a writer connecting to a unix socket
+// Only the dnstap fields used by the parser are decoded; other protobuf fields are skipped
+class DnstapReader {
+    public:
+        DnstapReader();
+        ~DnstapReader();
+
+        DnstapReader(const DnstapReader&) = delete;
+        DnstapReader& operator=(const DnstapReader&) = delete;
+
+        bool openFile(const string& path);
+        bool listen(const string& socketPath);
+        bool next(DnstapMessage& message);
+        void close();
+
+        dnstapError getError();
+        unsigned long getFrames();
+
+        static bool decodeMessage(const unsigned char* data, size_t size, DnstapMessage& message);
+        static string typeName(unsigned int type);
+        static string protocolName(unsigned int protocol);
+        static string printableAddress(const string& address);
+
+        // Stand-in for a resolver - replays the frames of a file to a reader listening on a unix socket
+        static bool replay(const string& path, const string& socketPath, unsigned long& frames);
+
+    private:
+        MappedFile file;
+        size_t fileOffset;
+        int listenSocket;
+        int connection;
+        string socketPath;
+
+        // Socket input is read into this buffer one frame at a time
+        vector<unsigned char> frameBuffer;
+
+        bool started;
+        bool stopped;
+        unsigned long frames;
+        dnstapError error;
+
+        bool fail(dnstapError reason);
+        bool readExact(size_t length, const unsigned char*& bytes, bool& ended);
+        bool readFrame(const unsigned char*& payload, uint32_t& length, bool& control, bool& ended);
+        bool handleControl(const unsigned char* payload, uint32_t length);
+        bool sendControl(unsigned int type);
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+using namespace std;
+
+// Defines every supported encoding of DNS messages in the input
+// FORMAT_ESCAPED_HEX covers the "\x9b\x4c..." and "x7exbd..." styles, optionally quoted and split over lines
+// FORMAT_BASE64 accepts both base64 and base64url, and extracts the "dns=" parameter of DoH request URLs
+// FORMAT_RAW_BINARY holds wire format messages, each prefixed by its length as a 16 bit big endian value
+enum inputFormat { FORMAT_AUTO, FORMAT_ESCAPED_HEX, FORMAT_PLAIN_HEX, FORMAT_BASE64, FORMAT_RAW_BINARY };
+
+// Converts a single hex character to its value - returns -1 if it is not a hex digit
+// Defined here so the parser and the suffix matcher can inline it in their per-byte loops
+inline int hexValue(char hexChar) {
+    if(hexChar >= '0' && hexChar <= '9') {
+        return hexChar - '0';
+    }
+    if(hexChar >= 'A' && hexChar <= 'F') {
+        return hexChar - 'A' + 10;
+    }
+    if(hexChar >= 'a' && hexChar <= 'f') {
+        return hexChar - 'a' + 10;
+    }
+    return -1;
+}
+
+// Decodes a single message of one input format into the upper case hex string parsed by DNSMessage
+// Returns false if the input contains anything that does not belong to the format
+template<inputFormat Format>
+struct MessageDecoder {
+    static bool decode(const string& input, string& hexData);
+};
+
+template<> bool MessageDecoder<FORMAT_ESCAPED_HEX>::decode(const string& input, string& hexData);
+template<> bool MessageDecoder<FORMAT_PLAIN_HEX>::decode(const string& input, string& hexData);
+template<> bool MessageDecoder<FORMAT_BASE64>::decode(const string& input, string& hexData);
+template<> bool MessageDecoder<FORMAT_RAW_BINARY>::decode(const string& input, string& hexData);
+
+// Encodes wire format bytes into the upper case hex string parsed by DNSMessage
+void encodeHex(const unsigned char* data, size_t length, string& hexData);
+
+// Decodes a message with the decoder of the given format (detecting the format first for FORMAT_AUTO)
+bool decodeMessage(inputFormat format, const string& input, string& hexData);
+
+// Detects the format of a stream from a sample of its first bytes
+inputFormat detectFormat(const char* sample, size_t size);
+
+// Reads a format name given on the command line - returns FORMAT_AUTO for unknown names
+inputFormat parseFormatName(const string& name, bool& valid);
+string formatName(inputFormat format);
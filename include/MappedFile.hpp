@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+// Read-only view of a whole file, memory-mapped where the platform supports it
+class MappedFile {
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const string& path);
+        void close();
+
+        const unsigned char* data() const;
+        size_t size() const;
+
+    private:
+        const unsigned char* mapData;
+        size_t mapSize;
+
+        // Fallback storage for platforms without mmap
+        vector<unsigned char> fileData;
+};
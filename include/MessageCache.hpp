@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <DNSMessage.hpp>
+
+using namespace std;
+
+// Single cached message, keyed by its wire bytes with the ID and TTLs masked out
+struct CacheEntry {
+    uint64_t hash;
+    string key;
+    DNSMessage message;
+    size_t bytes;
+    bool referenced;
+};
+
+// Independently locked part of the cache with its own share of the memory cap
+struct CacheShard {
+    mutex lock;
+    vector<CacheEntry> entries;
+    unordered_map<uint64_t, size_t> index;
+    vector<size_t> freeSlots;
+    size_t clockHand;
+    size_t bytes;
+};
+
+// Fixed-size cache of parsed messages with CLOCK eviction, safe to share between threads
+class MessageCache {
+    public:
+        // Smallest cap that leaves every shard room for several typical entries
+        static const size_t minBytes = 64 * 1024;
+
+        MessageCache(size_t cacheBytes);
+
+        MessageCache(const MessageCache&) = delete;
+        MessageCache& operator=(const MessageCache&) = delete;
+
+        bool lookup(const string& key, uint64_t hash, DNSMessage& message);
+        void insert(const string& key, uint64_t hash, DNSMessage& message);
+
+        static uint64_t hashKey(const string& key);
+
+        unsigned long getHits() const;
+        unsigned long getMisses() const;
+        unsigned long getEvictions() const;
+        unsigned long getEntries() const;
+        size_t getBytes() const;
+        size_t getMaxBytes() const;
+
+    private:
+        static const int shardCount = 16;
+
+        CacheShard shards[shardCount];
+        size_t maxBytes;
+        size_t shardBytes;
+
+        atomic<unsigned long> hits;
+        atomic<unsigned long> misses;
+        atomic<unsigned long> evictions;
+        atomic<unsigned long> entryCount;
+        atomic<size_t> totalBytes;
+
+        bool evictOne(CacheShard& shard);
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include <DNSMessage.hpp>
+
+using namespace std;
+
+// Identifies a query and the response that answers it
+struct CorrelationKey {
+    string client;
+    unsigned int port;
+    unsigned int id;
+    string qName;
+    unsigned int qType;
+
+    bool operator==(const CorrelationKey& other) const;
+};
+
+struct CorrelationKeyHash {
+    size_t operator()(const CorrelationKey& key) const;
+};
+
+// Outstanding query, linked into a slot of the timing wheel until it is answered or expires
+struct PendingQuery {
+    CorrelationKey key;
+    uint64_t queryTime;
+    uint64_t expiryTick;
+    int level;
+    int slot;
+    PendingQuery* prev;
+    PendingQuery* next;
+};
+
+// Query and response matched by the correlator (times in nanoseconds)
+struct CorrelatedPair {
+    CorrelationKey key;
+    uint64_t queryTime;
+    uint64_t responseTime;
+    uint64_t latency;
+    unsigned int rcode;
+};
+
+// Hierarchical timing wheel - each level has 64 slots, each slot spanning 64 slots of the level below
+class TimingWheel {
+    public:
+        TimingWheel();
+
+        void start(uint64_t tick);
+        void schedule(PendingQuery* entry);
+        void cancel(PendingQuery* entry);
+        void advance(uint64_t tick, vector<PendingQuery*>& expired);
+        uint64_t getTick() const;
+
+    private:
+        static const int levels = 4;
+        static const int slotBits = 6;
+        static const int slotCount = 1 << slotBits;
+
+        PendingQuery* slots[levels][slotCount];
+        uint64_t currentTick;
+        unsigned long entryCount;
+
+        void link(PendingQuery* entry);
+        void cascade(int level);
+        uint64_t nextEventTick() const;
+};
+
+// Latency histogram with logarithmic buckets (16 sub-buckets per power of two, about 6% precision)
+class LatencyHistogram {
+    public:
+        LatencyHistogram();
+
+        void record(uint64_t latency);
+        void merge(const LatencyHistogram& other);
+        uint64_t percentile(double percent) const;
+        uint64_t getCount() const;
+        uint64_t getMax() const;
+        uint64_t getMean() const;
+
+    private:
+        static const int subBucketBits = 4;
+        static const int bucketCount = 64 << subBucketBits;
+
+        vector<uint64_t> buckets;
+        uint64_t count;
+        uint64_t total;
+        uint64_t maximum;
+
+        static int bucketIndex(uint64_t value);
+        static uint64_t bucketValue(int index);
+};
+
+// Independently locked part of the correlator with its own table, wheel and counters
+struct CorrelatorShard {
+    mutex lock;
+    unordered_map<CorrelationKey, PendingQuery, CorrelationKeyHash> pending;
+    TimingWheel wheel;
+    bool started;
+    LatencyHistogram latencies;
+    unsigned long queries;
+    unsigned long responses;
+    unsigned long matched;
+    unsigned long timeouts;
+    unsigned long unmatched;
+    unsigned long dropped;
+};
+
+// Totals over every shard of the correlator
+struct CorrelationStats {
+    unsigned long queries;
+    unsigned long responses;
+    unsigned long matched;
+    unsigned long timeouts;
+    unsigned long unmatched;
+    unsigned long dropped;
+    unsigned long outstanding;
+    LatencyHistogram latencies;
+};
+
+// Matches queries with their responses by (client address/port, ID, qname, qtype)
+// Queries that are not answered within the timeout are expired through the timing wheel
+class QueryCorrelator {
+    public:
+        QueryCorrelator(uint64_t queryTimeout, unsigned long maxOutstanding);
+
+        QueryCorrelator(const QueryCorrelator&) = delete;
+        QueryCorrelator& operator=(const QueryCorrelator&) = delete;
+
+        bool observe(DNSMessage& message, const string& client, unsigned int port, uint64_t time, CorrelatedPair& pair);
+        void advance(uint64_t time);
+        CorrelationStats getStats();
+
+    private:
+        static const int shardCount = 16;
+
+        // Resolution of the timing wheel
+        static const uint64_t tickLength = 1000000;
+
+        CorrelatorShard shards[shardCount];
+        uint64_t timeout;
+        unsigned long maxShardOutstanding;
+
+        void expire(CorrelatorShard& shard, uint64_t time);
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <DNSMessage.hpp>
+#include <MappedFile.hpp>
+
+using namespace std;
+
+// Segment file layout (all values in host byte order):
+//   "DNSSEG01" followed by records of
+//   uint32 length | uint64 timestamp | uint16 id | uint16 flags | uint16 qd/an/ns/ar counts |
+//   uint16 stored questions | uint16 stored records | questions | records
+// Names and record data are stored as uint8 or uint16 length prefixed text.
+//
+// Index file layout (segment path + ".idx"), one run appended by every store session:
+//   (StoreIndexHeader | StoreIndexEntry[entryCount] sorted by hash, then offset)*
+// Each run indexes the records added since the previous run, up to segmentBytes of the segment.
+// Every distinct name of a record is indexed by the hash of "=" + name, and every
+// parent domain of those names by the hash of "~" + parent, to answer suffix lookups.
+// Hashes are 64 bit xxHash values (XXHash.hpp); changing that function invalidates existing index files.
+struct StoreIndexHeader {
+    char magic[8];
+    uint64_t entryCount;
+    uint64_t segmentBytes;
+};
+
+struct StoreIndexEntry {
+    uint64_t hash;
+    uint64_t offset;
+};
+
+// Sorted entries of one index run, pointing into the mapped index file
+struct StoreIndexRun {
+    const StoreIndexEntry* entries;
+    uint64_t entryCount;
+};
+
+// Single message read back from a segment file
+struct StoredRecord {
+    uint64_t offset;
+    uint64_t timestamp;
+    unsigned int dnsID;
+    DNSFlags headerFlags;
+    unsigned int counts[4];
+    vector<DNSQuestion> questions;
+    vector<ResourceRecord> answers;
+    vector<ResourceRecord> authority;
+    vector<ResourceRecord> additional;
+};
+
+// Appends parsed messages to a segment file and builds its name index while writing
+class RecordStore {
+    public:
+        RecordStore();
+        ~RecordStore();
+
+        RecordStore(const RecordStore&) = delete;
+        RecordStore& operator=(const RecordStore&) = delete;
+
+        bool open(const string& path);
+        bool append(DNSMessage& message, uint64_t timestamp);
+        bool close();
+
+    private:
+        string segmentPath;
+        ofstream segment;
+        uint64_t segmentBytes;
+
+        // Segment size covered by the runs already in the index file
+        uint64_t indexedBytes;
+
+        // Entries of the records added in this session, written as a new run on close
+        vector<StoreIndexEntry> index;
+};
+
+// Answers point and suffix lookups on a segment file through the runs of its memory-mapped index
+class RecordStoreReader {
+    public:
+        RecordStoreReader();
+
+        bool open(const string& path);
+        void find(const string& name, bool suffix, vector<StoredRecord>& results);
+
+        static bool decodeRecord(const unsigned char* data, size_t size, uint64_t offset, StoredRecord& record, uint64_t& next);
+        static uint64_t nameHash(const string& name, bool suffix);
+        static uint64_t scanSegment(const unsigned char* data, size_t size, uint64_t begin, vector<StoreIndexEntry>& entries);
+
+    private:
+        MappedFile segment;
+        MappedFile indexFile;
+        vector<StoreIndexRun> runs;
+
+        // Records written after the index was last saved are indexed when the store is opened
+        vector<StoreIndexEntry> tailEntries;
+
+        void findEntries(const StoreIndexEntry* begin, const StoreIndexEntry* end, uint64_t hash, vector<uint64_t>& offsets);
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <MappedFile.hpp>
+
+using namespace std;
+
+// Layout of a compiled suffix list image (all values in host byte order):
+//   SuffixImageHeader | SuffixNode[nodeCount] | SuffixEdge[edgeCount] | label bytes
+// Node 0 is the root. The edges of a node are contiguous and sorted by label,
+// and each edge leads one label further from the root (e.g. "com" -> "example").
+struct SuffixImageHeader {
+    char magic[8];
+    uint32_t nodeCount;
+    uint32_t edgeCount;
+    uint32_t labelBytes;
+    uint32_t entryCount;
+};
+
+struct SuffixNode {
+    uint32_t firstEdge;
+    uint32_t edgeCount;
+    uint32_t terminal;
+};
+
+struct SuffixEdge {
+    uint32_t labelOffset;
+    uint32_t labelLength;
+    uint32_t child;
+};
+
+// Matches DNS names against a list of domain suffixes using a reversed-label trie
+// A list entry "example.com" matches "example.com." and every name below it
+class SuffixMatcher {
+    public:
+        SuffixMatcher();
+
+        bool load(const string& path);
+        static bool compileList(const string& listPath, const string& imagePath, unsigned long& entries);
+
+        int match(const string& hexData, int begin) const;
+        bool empty() const;
+
+    private:
+        // Deepest name that can be looked up - a 255 byte name has at most 127 labels
+        static const int maxLabels = 128;
+
+        MappedFile mappedImage;
+        vector<unsigned char> builtImage;
+
+        const SuffixNode* nodes;
+        const SuffixEdge* edges;
+        const unsigned char* labels;
+        uint32_t nodeCount;
+        uint32_t edgeCount;
+        uint32_t labelBytes;
+
+        bool attachImage(const unsigned char* image, size_t size);
+        static bool buildImage(const string& listPath, vector<unsigned char>& image, unsigned long& entries);
+        int compareLabel(const string& hexData, int begin, unsigned int length, const SuffixEdge& edge) const;
+};
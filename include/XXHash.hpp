@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+using namespace std;
+
+// 64 bit xxHash (seed 0) of the bytes of a string, in host byte order
+// Shared by the response cache and the record store index, whose files depend on its exact output
+uint64_t xxHash64(const string& key);
@@ -0,0 +1,424 @@
+#include <unordered_map>
+#include <algorithm>
+#include <cctype>
+#include <utility>
+#include <DNSFilter.hpp>
+#include <DNSMessage.hpp>
+
+using namespace std;
+
+DNSFilter::DNSFilter() {
+    questionFields = false;
+    tokenPos = 0;
+    stackDepth = 0;
+    maxDepth = 0;
+    nestingDepth = 0;
+}
+
+// Compiles a filter expression into a postfix predicate program
+filterError DNSFilter::compile(string expression) {
+    program.clear();
+    tokens.clear();
+    questionFields = false;
+    tokenPos = 0;
+    stackDepth = 0;
+    maxDepth = 0;
+    nestingDepth = 0;
+
+    filterError error = tokenize(expression);
+    if(error != FILTER_VALID) {
+        return error;
+    }
+    if(tokens.empty()) {
+        return FILTER_SYNTAX_ERROR;
+    }
+
+    error = parseOr();
+    if(error == FILTER_VALID && cmp_less(tokenPos, tokens.size())) {
+        // Trailing tokens that do not belong to the expression
+        error = FILTER_SYNTAX_ERROR;
+    }
+    if(error == FILTER_VALID && maxDepth > maxStackDepth) {
+        error = FILTER_DEPTH_ERROR;
+    }
+    if(error != FILTER_VALID) {
+        program.clear();
+        questionFields = false;
+    }
+
+    tokens.clear();
+    return error;
+}
+
+// Returns true if the filter needs the question section to be parsed before evaluation
+bool DNSFilter::needsQuestions() const {
+    return questionFields;
+}
+
+// Returns true if no expression has been compiled
+bool DNSFilter::empty() const {
+    return program.empty();
+}
+
+// Evaluates the compiled program against the parsed header and question data
+bool DNSFilter::matches(DNSMessage& message) const {
+    bool stack[maxStackDepth];
+    int top = 0;
+
+    if(program.empty()) {
+        return true;
+    }
+
+    for(int i = 0; cmp_less(i, program.size()); i++) {
+        const FilterInstruction& instruction = program[i];
+        switch(instruction.op) {
+            case OP_AND:
+                top--;
+                stack[top - 1] = stack[top - 1] && stack[top];
+                break;
+            case OP_OR:
+                top--;
+                stack[top - 1] = stack[top - 1] || stack[top];
+                break;
+            case OP_NOT:
+                stack[top - 1] = !stack[top - 1];
+                break;
+            default:
+                stack[top++] = testField(instruction, message);
+                break;
+        }
+    }
+
+    return stack[0];
+}
+
+// Splits the expression into identifier, operator and parenthesis tokens
+filterError DNSFilter::tokenize(string& expression) {
+    vector<string> operators = {"&&", "||", "==", "!=", "<=", ">=", "~=", "=", "<", ">", "!", "(", ")"};
+
+    for(int i = 0; cmp_less(i, expression.length());) {
+        char currChar = expression[i];
+
+        if(isspace(static_cast<unsigned char>(currChar))) {
+            i++;
+            continue;
+        }
+
+        if(isalnum(static_cast<unsigned char>(currChar)) || currChar == '.' || currChar == '-' || currChar == '_' || currChar == '*') {
+            int start = i;
+            while(cmp_less(i, expression.length()) &&
+                  (isalnum(static_cast<unsigned char>(expression[i])) || expression[i] == '.' || expression[i] == '-' ||
+                   expression[i] == '_' || expression[i] == '*')) {
+                i++;
+            }
+            tokens.push_back(expression.substr(start, i - start));
+            continue;
+        }
+
+        bool found = false;
+        for(int j = 0; cmp_less(j, operators.size()); j++) {
+            if(expression.compare(i, operators[j].length(), operators[j]) == 0) {
+                tokens.push_back(operators[j]);
+                i += operators[j].length();
+                found = true;
+                break;
+            }
+        }
+        if(!found) {
+            return FILTER_SYNTAX_ERROR;
+        }
+    }
+
+    return FILTER_VALID;
+}
+
+// expression := and-expression ('||' and-expression)*
+filterError DNSFilter::parseOr() {
+    filterError error = parseAnd();
+
+    while(error == FILTER_VALID && cmp_less(tokenPos, tokens.size()) && tokens[tokenPos] == "||") {
+        tokenPos++;
+        error = parseAnd();
+        emit({OP_OR, FIELD_ID, 0, string()});
+    }
+
+    return error;
+}
+
+// and-expression := unary ('&&' unary)*
+filterError DNSFilter::parseAnd() {
+    filterError error = parseUnary();
+
+    while(error == FILTER_VALID && cmp_less(tokenPos, tokens.size()) && tokens[tokenPos] == "&&") {
+        tokenPos++;
+        error = parseUnary();
+        emit({OP_AND, FIELD_ID, 0, string()});
+    }
+
+    return error;
+}
+
+// unary := '!' unary | '(' expression ')' | comparison
+filterError DNSFilter::parseUnary() {
+    if(!cmp_less(tokenPos, tokens.size())) {
+        return FILTER_SYNTAX_ERROR;
+    }
+
+    // Every '!' and '(' recurses, so their nesting is bounded before the call stack is
+    if((tokens[tokenPos] == "!" || tokens[tokenPos] == "(") && nestingDepth >= maxNestingDepth) {
+        return FILTER_DEPTH_ERROR;
+    }
+
+    if(tokens[tokenPos] == "!") {
+        tokenPos++;
+        nestingDepth++;
+        filterError error = parseUnary();
+        nestingDepth--;
+        emit({OP_NOT, FIELD_ID, 0, string()});
+        return error;
+    }
+
+    if(tokens[tokenPos] == "(") {
+        tokenPos++;
+        nestingDepth++;
+        filterError error = parseOr();
+        nestingDepth--;
+        if(error != FILTER_VALID) {
+            return error;
+        }
+        if(!cmp_less(tokenPos, tokens.size()) || tokens[tokenPos] != ")") {
+            return FILTER_SYNTAX_ERROR;
+        }
+        tokenPos++;
+        return FILTER_VALID;
+    }
+
+    return parseComparison();
+}
+
+// comparison := field operator value | field
+// A bare field is true when its value is non-zero (e.g. "tc" is the same as "tc!=0")
+filterError DNSFilter::parseComparison() {
+    unordered_map<string, filterField> fieldMap = {
+        {"id", FIELD_ID}, {"qr", FIELD_QR}, {"opcode", FIELD_OPCODE}, {"aa", FIELD_AA},
+        {"tc", FIELD_TC}, {"rd", FIELD_RD}, {"ra", FIELD_RA}, {"z", FIELD_Z},
+        {"rcode", FIELD_RCODE}, {"qdcount", FIELD_QDCOUNT}, {"ancount", FIELD_ANCOUNT},
+        {"nscount", FIELD_NSCOUNT}, {"arcount", FIELD_ARCOUNT}, {"qname", FIELD_QNAME},
+        {"qtype", FIELD_QTYPE}, {"qclass", FIELD_QCLASS} };
+    unordered_map<string, filterOpcode> opMap = {
+        {"=", OP_EQ}, {"==", OP_EQ}, {"!=", OP_NE}, {"<", OP_LT},
+        {"<=", OP_LE}, {">", OP_GT}, {">=", OP_GE}, {"~=", OP_SUFFIX} };
+
+    string fieldName = tokens[tokenPos++];
+    transform(fieldName.begin(), fieldName.end(), fieldName.begin(), ::tolower);
+
+    if(fieldMap.find(fieldName) == fieldMap.end()) {
+        return FILTER_FIELD_ERROR;
+    }
+    filterField field = fieldMap[fieldName];
+
+    if(field == FIELD_QNAME || field == FIELD_QTYPE || field == FIELD_QCLASS) {
+        questionFields = true;
+    }
+
+    FilterInstruction instruction = {OP_NE, field, 0, string()};
+
+    if(!cmp_less(tokenPos, tokens.size()) || opMap.find(tokens[tokenPos]) == opMap.end()) {
+        // Bare field - names have no numeric value to test
+        if(field == FIELD_QNAME) {
+            return FILTER_SYNTAX_ERROR;
+        }
+        emit(instruction);
+        return FILTER_VALID;
+    }
+
+    instruction.op = opMap[tokens[tokenPos++]];
+    if(!cmp_less(tokenPos, tokens.size())) {
+        return FILTER_SYNTAX_ERROR;
+    }
+
+    // Names only support equality and suffix tests, numbers do not support suffix tests
+    if(field == FIELD_QNAME && instruction.op != OP_EQ && instruction.op != OP_NE && instruction.op != OP_SUFFIX) {
+        return FILTER_SYNTAX_ERROR;
+    }
+    if(field != FIELD_QNAME && instruction.op == OP_SUFFIX) {
+        return FILTER_SYNTAX_ERROR;
+    }
+
+    filterError error = parseValue(field, tokens[tokenPos++], instruction);
+    if(error != FILTER_VALID) {
+        return error;
+    }
+
+    emit(instruction);
+    return FILTER_VALID;
+}
+
+// Converts a value token into a number (or a normalized name) for the given field
+filterError DNSFilter::parseValue(filterField field, string value, FilterInstruction& instruction) {
+    // This can be refactored to read types from a different source (e.g. a file)
+    unordered_map<string, unsigned int> opcodeMap = {
+        {"QUERY", 0}, {"IQUERY", 1}, {"STATUS", 2}, {"NOTIFY", 4}, {"UPDATE", 5}, {"DSO", 6} };
+    unordered_map<string, unsigned int> rcodeMap = {
+        {"NOERROR", 0}, {"FORMERR", 1}, {"SERVFAIL", 2}, {"NXDOMAIN", 3},
+        {"NOTIMP", 4}, {"REFUSED", 5}, {"YXDOMAIN", 6}, {"YXRRSET", 7},
+        {"NXRRSET", 8}, {"NOTAUTH", 9} };
+    unordered_map<string, unsigned int> typeMap = {
+        {"A", 1}, {"NS", 2}, {"MD", 3}, {"MF", 4}, {"CNAME", 5}, {"SOA", 6},
+        {"MB", 7}, {"MG", 8}, {"MR", 9}, {"NULL", 10}, {"WKS", 11}, {"PTR", 12},
+        {"HINFO", 13}, {"MINFO", 14}, {"MX", 15}, {"TXT", 16}, {"RP", 17}, {"AFSDB", 18},
+        {"X25", 19}, {"ISDN", 20}, {"RT", 21}, {"NSAP", 22}, {"NSAP-PTR", 23}, {"SIG", 24},
+        {"KEY", 25}, {"PX", 26}, {"GPOS", 27}, {"AAAA", 28}, {"LOC", 29}, {"NXT", 30},
+        {"EID", 31}, {"NIMLOC", 32}, {"SRV", 33}, {"ATMA", 34}, {"NAPTR", 35}, {"KX", 36},
+        {"CERT", 37}, {"A6", 38}, {"DNAME", 39}, {"SINK", 40}, {"OPT", 41}, {"APL", 42},
+        {"DS", 43}, {"SSHFP", 44}, {"IPSECKEY", 45}, {"RRSIG", 46}, {"NSEC", 47}, {"DNSKEY", 48},
+        {"DHCID", 49}, {"NSEC3", 50}, {"NSEC3PARAM", 51}, {"TLSA", 52}, {"SMIMEA", 53}, {"HIP", 55},
+        {"NINFO", 56}, {"RKEY", 57}, {"TALINK", 58}, {"CDS", 59}, {"CDNSKEY", 60}, {"OPENGPKEY", 61},
+        {"CSYNC", 62}, {"ZONEMD", 63}, {"SVCB", 64}, {"HTTPS", 65}, {"SPF", 99}, {"UINFO", 100},
+        {"UID", 101}, {"GID", 102}, {"UNSPEC", 103}, {"NID", 104}, {"L32", 105}, {"L64", 106},
+        {"LP", 107}, {"EUI48", 108}, {"EUI64", 109}, {"TKEY", 249}, {"TSIG", 250}, {"IXFR", 251},
+        {"AXFR", 252}, {"MAILB", 253}, {"MAILA", 254}, {"*", 255}, {"ANY", 255}, {"URI", 256},
+        {"CAA", 257}, {"AVC", 258}, {"DOA", 259}, {"AMTRELAY", 260}, {"TA", 32768}, {"DLV", 32769} };
+    unordered_map<string, unsigned int> classMap = {
+        {"IN", 1}, {"CH", 3}, {"HS", 4}, {"NONE", 254}, {"ANY", 255} };
+
+    if(field == FIELD_QNAME) {
+        // Names are compared in lower case and always end with the root label
+        transform(value.begin(), value.end(), value.begin(), ::tolower);
+        if(value.empty() || value.back() != '.') {
+            value += '.';
+        }
+        instruction.name = value;
+        return FILTER_VALID;
+    }
+
+    string upperValue = value;
+    transform(upperValue.begin(), upperValue.end(), upperValue.begin(), ::toupper);
+
+    unordered_map<string, unsigned int>* names = nullptr;
+    if(field == FIELD_OPCODE) {
+        names = &opcodeMap;
+    }
+    else if(field == FIELD_RCODE) {
+        names = &rcodeMap;
+    }
+    else if(field == FIELD_QTYPE) {
+        names = &typeMap;
+    }
+    else if(field == FIELD_QCLASS) {
+        names = &classMap;
+    }
+
+    if(names && names->find(upperValue) != names->end()) {
+        instruction.value = (*names)[upperValue];
+        return FILTER_VALID;
+    }
+
+    // Generic numeric value (decimal or 0x prefixed hex)
+    size_t length = 0;
+    try {
+        unsigned long number = stoul(value, &length, 0);
+        if(length != value.length() || number > 0xFFFF) {
+            return FILTER_VALUE_ERROR;
+        }
+        instruction.value = number;
+    }
+    catch(...) {
+        return FILTER_VALUE_ERROR;
+    }
+
+    return FILTER_VALID;
+}
+
+// Appends an instruction to the program and tracks the evaluation stack depth it needs
+void DNSFilter::emit(FilterInstruction instruction) {
+    if(instruction.op == OP_AND || instruction.op == OP_OR) {
+        stackDepth--;
+    }
+    else if(instruction.op != OP_NOT) {
+        stackDepth++;
+    }
+    maxDepth = max(maxDepth, stackDepth);
+
+    program.push_back(instruction);
+}
+
+// Tests a single field comparison - question fields match if any question matches
+bool DNSFilter::testField(const FilterInstruction& instruction, DNSMessage& message) const {
+    DNSFlags flags = message.getFlags();
+    unsigned int value = 0;
+
+    switch(instruction.field) {
+        case FIELD_ID:      value = message.getID(); break;
+        case FIELD_QR:      value = flags.QR; break;
+        case FIELD_OPCODE:  value = flags.OPCODE; break;
+        case FIELD_AA:      value = flags.AA; break;
+        case FIELD_TC:      value = flags.TC; break;
+        case FIELD_RD:      value = flags.RD; break;
+        case FIELD_RA:      value = flags.RA; break;
+        case FIELD_Z:       value = flags.Z; break;
+        case FIELD_RCODE:   value = flags.RCODE; break;
+        case FIELD_QDCOUNT: value = message.getQDCount(); break;
+        case FIELD_ANCOUNT: value = message.getANCount(); break;
+        case FIELD_NSCOUNT: value = message.getNSCount(); break;
+        case FIELD_ARCOUNT: value = message.getARCount(); break;
+        default: {
+            const vector<DNSQuestion>& questions = message.getQuestions();
+            for(int i = 0; cmp_less(i, questions.size()); i++) {
+                bool result = false;
+                if(instruction.field == FIELD_QNAME) {
+                    result = compareName(instruction.op, questions[i].qName, instruction.name);
+                }
+                else if(instruction.field == FIELD_QTYPE) {
+                    result = compareValue(instruction.op, questions[i].qType, instruction.value);
+                }
+                else {
+                    result = compareValue(instruction.op, questions[i].qClass, instruction.value);
+                }
+                if(result) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+
+    return compareValue(instruction.op, value, instruction.value);
+}
+
+// Compares two numeric values with the given operator
+bool DNSFilter::compareValue(filterOpcode op, unsigned int left, unsigned int right) const {
+    switch(op) {
+        case OP_EQ: return left == right;
+        case OP_NE: return left != right;
+        case OP_LT: return left < right;
+        case OP_LE: return left <= right;
+        case OP_GT: return left > right;
+        case OP_GE: return left >= right;
+        default:    return false;
+    }
+}
+
+// Compares a parsed question name with a normalized filter name, ignoring case
+// Suffix tests only match on label boundaries ("example.com." matches "www.example.com.")
+bool DNSFilter::compareName(filterOpcode op, const string& qName, const string& filterName) const {
+    if(qName.length() < filterName.length()) {
+        return op == OP_NE;
+    }
+
+    int start = qName.length() - filterName.length();
+    bool suffixEqual = true;
+    for(int i = 0; cmp_less(i, filterName.length()); i++) {
+        if(tolower(static_cast<unsigned char>(qName[start + i])) != filterName[i]) {
+            suffixEqual = false;
+            break;
+        }
+    }
+
+    if(op == OP_SUFFIX) {
+        return suffixEqual && (start == 0 || qName[start - 1] == '.' || filterName == ".");
+    }
+
+    bool equal = suffixEqual && start == 0;
+    return op == OP_EQ ? equal : !equal;
+}
@@ -3,6 +3,9 @@
 #include <algorithm>
 #include <utility>
 #include <DNSMessage.hpp>
+#include <DNSFilter.hpp>
+#include <SuffixMatcher.hpp>
+#include <MessageCache.hpp>
 
 using namespace std;
 
@@ -13,29 +16,293 @@ DNSMessage::DNSMessage() {
     anCount = 0;
     nsCount = 0;
     arCount = 0;
+    matcher = nullptr;
+    filtered = false;
+    cached = false;
+    skippedBytes = 0;
 }
 
 // Creates DNSMessage object from hex formatted string
-DNSMessage::DNSMessage(string hexData) {
-    int nextSection = 0;
+DNSMessage::DNSMessage(string hexData) : DNSMessage() {
+    DNSParseOptions options = {};
+    parse(hexData, options);
+}
+
+// Creates DNSMessage object from hex formatted string, applying the given parse options
+DNSMessage::DNSMessage(string hexData, const DNSParseOptions& options) : DNSMessage() {
+    parse(hexData, options);
+}
+
+// Creates DNSMessage object from wire format bytes, applying the given parse options
+DNSMessage::DNSMessage(const unsigned char* wireData, size_t length, const DNSParseOptions& options) : DNSMessage() {
+    // Minimum of 12 bytes to have complete header data
+    const size_t minLength = 12;
+
+    if(length < minLength) {
+        cout << "Error: Incomplete DNS message header. Extracting data as empty." << endl;
+        return;
+    }
 
-    if(extractRawHex(hexData) < 1) {
-        dnsID = 0;
-        headerFlags = {};
-        qdCount = 0;
-        anCount = 0;
-        nsCount = 0;
-        arCount = 0;
+    // Wire data needs no format decoding, only the hex encoding used by the parser
+    string hexData;
+    encodeHex(wireData, length, hexData);
+    parseDecoded(hexData, options);
+}
 
+// Parses hex formatted string into the message sections
+void DNSMessage::parse(string& hexData, const DNSParseOptions& options) {
+    if(extractRawHex(hexData, options) < 1) {
         // TODO: Throw/catch error to prevent object creation
         cout << "Error: Invalid hex encoded string. Extracting data as empty." << endl;
+        return;
     }
-    else {
-        parseHeader(hexData, nextSection);
-        parseQuestions(hexData, nextSection);
-        parseResourceRecords(hexData, nextSection);
+
+    parseDecoded(hexData, options);
+}
+
+// Parses upper case hex data into the message sections
+void DNSMessage::parseDecoded(string& hexData, const DNSParseOptions& options) {
+    int nextSection = 0;
+
+    matcher = options.matcher;
+    parseHeader(hexData, nextSection);
+
+    // Header-only filters can reject the message before any names are decoded
+    bool earlyFilter = !options.alwaysParseQuestions && options.filter && !options.filter->needsQuestions();
+    if(earlyFilter && !options.filter->matches(*this)) {
+        skipRemaining(hexData, nextSection);
+        return;
+    }
+
+    // Repeated messages only need their ID and TTLs patched into the cached copy
+    string cacheKey = string();
+    vector<int> ttlOffsets;
+    uint64_t cacheHash = 0;
+    int recordsBegin = 0;
+    if(options.cache && buildCacheKey(hexData, cacheKey, ttlOffsets, recordsBegin)) {
+        cacheHash = MessageCache::hashKey(cacheKey);
+        if(options.cache->lookup(cacheKey, cacheHash, *this)) {
+            patchCachedMessage(hexData, ttlOffsets);
+            if(options.filter && !earlyFilter && !options.filter->matches(*this)) {
+                skipRemaining(hexData, recordsBegin);
+            }
+            return;
+        }
+    }
+
+    parseQuestions(hexData, nextSection);
+
+    if(options.filter && !earlyFilter && !options.filter->matches(*this)) {
+        skipRemaining(hexData, nextSection);
+        return;
+    }
+
+    parseResourceRecords(hexData, nextSection);
+    matcher = nullptr;
+
+    // Only completely parsed messages are cached, so every TTL offset has a record to patch
+    if(!cacheKey.empty() && nextSection >= 0 &&
+       cmp_equal(answers.size() + authority.size() + additional.size(), ttlOffsets.size())) {
+        options.cache->insert(cacheKey, cacheHash, *this);
+    }
+}
+
+// Marks the message as rejected by a filter and records how many bytes were left undecoded
+void DNSMessage::skipRemaining(string& hexData, int begin) {
+    filtered = true;
+    if(begin >= 0 && cmp_less(begin, hexData.length())) {
+        skippedBytes = (hexData.length() - begin) / 2;
+    }
+}
+
+// Builds the cache key from the message bytes with the ID and every TTL masked out
+// Returns false if the message is too malformed to locate its TTLs
+// recordsBegin is set to the position of the first resource record in the hex data
+bool DNSMessage::buildCacheKey(string& hexData, string& key, vector<int>& ttlOffsets, int& recordsBegin) {
+    const int headerLength = 12;
+    const int questionFieldsLength = 4;
+    const int recordFieldsLength = 10;
+    const int ttlPosition = 4;
+    const int ttlLength = 4;
+
+    int length = hexData.length() / 2;
+    if(length < headerLength) {
+        return false;
+    }
+
+    key.resize(length);
+    for(int i = 0; i < length; i++) {
+        int high = hexValue(hexData[i * 2]);
+        int low = hexValue(hexData[i * 2 + 1]);
+        if(high < 0 || low < 0) {
+            key.clear();
+            return false;
+        }
+        key[i] = static_cast<char>((high << 4) | low);
+    }
+
+    // ID is the first two bytes of the header
+    key[0] = 0;
+    key[1] = 0;
+
+    unsigned int counts[4];
+    for(int i = 0; i < 4; i++) {
+        counts[i] = (static_cast<unsigned char>(key[4 + i * 2]) << 8) | static_cast<unsigned char>(key[5 + i * 2]);
+    }
+
+    int position = headerLength;
+    for(unsigned int i = 0; i < counts[0]; i++) {
+        position = skipName(key, position);
+        if(position < 0 || position + questionFieldsLength > length) {
+            key.clear();
+            return false;
+        }
+        position += questionFieldsLength;
+    }
+    recordsBegin = position * 2;
+
+    unsigned int recordCount = counts[1] + counts[2] + counts[3];
+    for(unsigned int i = 0; i < recordCount; i++) {
+        position = skipName(key, position);
+        if(position < 0 || position + recordFieldsLength > length) {
+            key.clear();
+            return false;
+        }
+
+        ttlOffsets.push_back(position + ttlPosition);
+        for(int j = 0; j < ttlLength; j++) {
+            key[position + ttlPosition + j] = 0;
+        }
+
+        unsigned int rdLength = (static_cast<unsigned char>(key[position + 8]) << 8) | static_cast<unsigned char>(key[position + 9]);
+        position += recordFieldsLength + rdLength;
+        if(position > length) {
+            key.clear();
+            return false;
+        }
     }
 
+    return true;
+}
+
+// Returns the byte position after the wire format name starting at begin, or -1 if it is malformed
+int DNSMessage::skipName(string& wireData, int begin) {
+    const int maxLabelLength = 63;
+    int length = wireData.length();
+
+    while(begin < length) {
+        unsigned int labelLength = static_cast<unsigned char>(wireData[begin]);
+        if((labelLength & 0xC0) == 0xC0) {
+            return (begin + 2 <= length) ? begin + 2 : -1;
+        }
+        if(labelLength == 0) {
+            return begin + 1;
+        }
+        if(labelLength > maxLabelLength) {
+            return -1;
+        }
+        begin += 1 + labelLength;
+    }
+
+    return -1;
+}
+
+// Replaces the ID and TTLs of a message copied from the cache with the values of this message
+void DNSMessage::patchCachedMessage(string& hexData, vector<int>& ttlOffsets) {
+    vector<ResourceRecord>* sections[3] = {&answers, &authority, &additional};
+    int record = 0;
+
+    dnsID = stoul(hexData.substr(0, 4), nullptr, 16);
+
+    for(int count = 0; count < 3; count++) {
+        for(int i = 0; cmp_less(i, sections[count]->size()) && cmp_less(record, ttlOffsets.size()); i++, record++) {
+            (*sections[count])[i].rTtl = static_cast<signed int>(stoul(hexData.substr(ttlOffsets[record] * 2, 8), nullptr, 16));
+        }
+    }
+
+    cached = true;
+}
+
+// Returns an estimate of the memory held by the message, including its strings
+size_t DNSMessage::getMemoryUsage() {
+    vector<ResourceRecord>* sections[3] = {&answers, &authority, &additional};
+    size_t bytes = sizeof(DNSMessage);
+
+    bytes += questions.capacity() * sizeof(DNSQuestion);
+    for(int i = 0; cmp_less(i, questions.size()); i++) {
+        bytes += questions[i].qName.capacity();
+    }
+    for(int count = 0; count < 3; count++) {
+        bytes += sections[count]->capacity() * sizeof(ResourceRecord);
+        for(int i = 0; cmp_less(i, sections[count]->size()); i++) {
+            bytes += (*sections[count])[i].rName.capacity() + (*sections[count])[i].rData.capacity();
+        }
+    }
+    bytes += suffixMatches.capacity() * sizeof(SuffixMatch);
+    for(int i = 0; cmp_less(i, suffixMatches.size()); i++) {
+        bytes += suffixMatches[i].name.capacity() + suffixMatches[i].suffix.capacity();
+    }
+
+    return bytes;
+}
+
+unsigned int DNSMessage::getID() {
+    return dnsID;
+}
+
+DNSFlags DNSMessage::getFlags() {
+    return headerFlags;
+}
+
+unsigned int DNSMessage::getQDCount() {
+    return qdCount;
+}
+
+unsigned int DNSMessage::getANCount() {
+    return anCount;
+}
+
+unsigned int DNSMessage::getNSCount() {
+    return nsCount;
+}
+
+unsigned int DNSMessage::getARCount() {
+    return arCount;
+}
+
+const vector<DNSQuestion>& DNSMessage::getQuestions() {
+    return questions;
+}
+
+const vector<ResourceRecord>& DNSMessage::getAnswers() {
+    return answers;
+}
+
+const vector<ResourceRecord>& DNSMessage::getAuthority() {
+    return authority;
+}
+
+const vector<ResourceRecord>& DNSMessage::getAdditional() {
+    return additional;
+}
+
+const vector<SuffixMatch>& DNSMessage::getSuffixMatches() {
+    return suffixMatches;
+}
+
+// Returns true if the message was rejected by a filter and its records were not decoded
+bool DNSMessage::isFiltered() {
+    return filtered;
+}
+
+// Returns true if the message was copied from the cache instead of being parsed
+bool DNSMessage::isCached() {
+    return cached;
+}
+
+// Returns the number of message bytes left undecoded because of a filter rejection
+unsigned int DNSMessage::getSkippedBytes() {
+    return skippedBytes;
 }
 
 // Prints DNS Object's data in proper format
@@ -44,6 +311,9 @@ void DNSMessage::printData() {
     output.append(printableHeader());
     output.append("\n" + printableQuestions());
     output.append("\n" + printableResourceRecords());
+    if(!suffixMatches.empty()) {
+        output.append("\n" + printableSuffixMatches());
+    }
     
     cout << output;
 }
@@ -54,31 +324,14 @@ string DNSMessage::printableHeader() {
     unordered_map<int, string> opcodeMap = {
         {0, "QUERY"}, {1, "IQUERY"}, {2, "STATUS"}, {3, "UNASSIGNED"},
         {4, "NOTIFY"}, {5, "UPDATE"}, {6, "DSO"} };
-    unordered_map<int, string> rcodeMap = {
-        {0, "NOERROR"}, {1,"FORMERR"}, {2,"SERVFAIL"}, {3,"NXDOMAIN"},
-        {4,"NOTIMP"}, {5,"REFUSED"}, {6,"YXDOMAIN"}, {7,"YXRRSET"},
-        {8,"NXRRSET"}, {9,"NOTAUTH"}, {10,"NOTAUTH"}, {11,"NOTAUTH"},
-        {12,"UNASSIGNED"}, {13,"UNASSIGNED"}, {14,"UNASSIGNED"}, {15,"UNASSIGNED"},
-        {16,"BADVERS/BADSIG"}, {17,"BADKEY"}, {18,"BADTIME"}, {19,"BADMODE"},
-        {20,"BADNAME"}, {21,"BADALG"}, {22,"BADTRUNC"}, {23,"BADCOOKIE"}, 
-        {65535, "RESERVED"} };
-        
+
     for(int i = 7; i <= 15; i++) {
         opcodeMap[i] = "UNASSIGNED";
     }
-    for(int i = 24; i <= 3840; i++) {
-        rcodeMap[i] = "UNASSIGNED";
-    }
-    for(int i = 3841; i <= 4095; i++) {
-        rcodeMap[i] = "RESERVED";
-    }
-    for(int i = 4096; i <= 65534; i++) {
-        rcodeMap[i] = "UNASSIGNED";
-    }
     
     string output = ";; ->>HEADER<<- ";
     output.append("opcode: " + opcodeMap[headerFlags.OPCODE] + ", ");
-    output.append("status: " + rcodeMap[headerFlags.RCODE] + ", ");
+    output.append("status: " + rcodeName(headerFlags.RCODE) + ", ");
     output.append("id: " + to_string(dnsID) + "\n");
 
     output.append(";; flags:");
@@ -104,10 +357,10 @@ string DNSMessage::printableHeader() {
     return output;
 }
 
-// Returns a string of question data in a readable format
-string DNSMessage::printableQuestions() {
+// Returns the mnemonic of a record type (e.g. "AAAA" for 28)
+string DNSMessage::typeName(unsigned int type) {
     // This can be refactored to read types from a different source (e.g. a file)
-    unordered_map<int, string> qTypes = {
+    static const unordered_map<int, string> typeMap = {
         {0, "RESERVED"}, {1, "A"}, {2, "NS"}, {3, "MD"},
         {4, "MF"}, {5, "CNAME"}, {6, "SOA"}, {7, "MB"},
         {8, "MG"}, {9, "MR"}, {10, "NULL"}, {11, "WKS"},
@@ -132,42 +385,63 @@ string DNSMessage::printableQuestions() {
         {256, "URI"}, {257, "CAA"}, {258, "AVC"}, {259, "DOA"},
         {260, "AMTRELAY"}, {32768, "TA"}, {32769, "DLV"}, {65535, "RESERVED"},
     };
-    unordered_map<int, string> classMap = {
-        {0, "RESERVED"}, {1, "IN"}, {2, "UNASSIGNED"}, {3, "CH"},
-        {4, "HS"}, {254, "NONE"}, {255, "ANY"} };
-    
-    for(int i = 5; i <= 253; i++) {
-        classMap[i] = "UNASSIGNED";
-    }
-    for(int i = 256; i <= 65279; i++) {
-        classMap[i] = "UNASSIGNED";
-    }
-    for(int i = 65280; i <= 65535; i++) {
-        classMap[i] = "RESERVED";
+
+    auto found = typeMap.find(type);
+    if(found != typeMap.end()) {
+        return found->second;
     }
-    for(int i = 66; i <= 98; i++) {
-        qTypes[i] = "UNASSIGNED";
+    if(type >= 65280 && type <= 65534) {
+        return "PRIVATE";
     }
-    for(int i = 110; i <= 248; i++) {
-        qTypes[i] = "UNASSIGNED";
+    return "UNASSIGNED";
+}
+
+// Returns the mnemonic of a response code (e.g. "NXDOMAIN" for 3)
+string DNSMessage::rcodeName(unsigned int rcode) {
+    static const unordered_map<int, string> rcodeMap = {
+        {0, "NOERROR"}, {1,"FORMERR"}, {2,"SERVFAIL"}, {3,"NXDOMAIN"},
+        {4,"NOTIMP"}, {5,"REFUSED"}, {6,"YXDOMAIN"}, {7,"YXRRSET"},
+        {8,"NXRRSET"}, {9,"NOTAUTH"}, {10,"NOTAUTH"}, {11,"NOTAUTH"},
+        {16,"BADVERS/BADSIG"}, {17,"BADKEY"}, {18,"BADTIME"}, {19,"BADMODE"},
+        {20,"BADNAME"}, {21,"BADALG"}, {22,"BADTRUNC"}, {23,"BADCOOKIE"}, 
+        {65535, "RESERVED"} };
+
+    auto found = rcodeMap.find(rcode);
+    if(found != rcodeMap.end()) {
+        return found->second;
     }
-    for(int i = 261; i <= 32767; i++) {
-        qTypes[i] = "UNASSIGNED";
+    if(rcode >= 3841 && rcode <= 4095) {
+        return "RESERVED";
     }
-    for(int i = 32770; i <= 65279; i++) {
-        qTypes[i] = "UNASSIGNED";
+    return "UNASSIGNED";
+}
+
+// Returns the mnemonic of a record class (e.g. "IN" for 1)
+string DNSMessage::className(unsigned int rClass) {
+    // This can be refactored to read classes from a different source (e.g. a file)
+    static const unordered_map<int, string> classMap = {
+        {0, "RESERVED"}, {1, "IN"}, {2, "UNASSIGNED"}, {3, "CH"},
+        {4, "HS"}, {254, "NONE"}, {255, "ANY"} };
+
+    auto found = classMap.find(rClass);
+    if(found != classMap.end()) {
+        return found->second;
     }
-    for(int i = 65280; i <= 65534; i++) {
-        qTypes[i] = "PRIVATE";
+    if(rClass >= 65280 && rClass <= 65535) {
+        return "RESERVED";
     }
-    
+    return "UNASSIGNED";
+}
+
+// Returns a string of question data in a readable format
+string DNSMessage::printableQuestions() {
     string output = string();
     if(qdCount) {
         output = ";; QUESTION SECTION:\n";
         for(int i = 0; i < questions.size(); i++) {
             output.append(";" + questions[i].qName + "\t\t");
-            output.append(classMap[questions[i].qClass] + "\t");
-            output.append(qTypes[questions[i].qType] + "\n");
+            output.append(className(questions[i].qClass) + "\t");
+            output.append(typeName(questions[i].qType) + "\n");
         }
     }
 
@@ -176,96 +450,49 @@ string DNSMessage::printableQuestions() {
 
 // Returns a string of data from all resource records in a readable format
 string DNSMessage::printableResourceRecords() {
-    // This can be refactored to read types from a different source (e.g. a file)
-    unordered_map<int, string> rrTypes = {
-        {0, "RESERVED"}, {1, "A"}, {2, "NS"}, {3, "MD"},
-        {4, "MF"}, {5, "CNAME"}, {6, "SOA"}, {7, "MB"},
-        {8, "MG"}, {9, "MR"}, {10, "NULL"}, {11, "WKS"},
-        {12, "PTR"}, {13, "HINFO"}, {14, "MINFO"}, {15, "MX"},
-        {16, "TXT"}, {17, "RP"}, {18, "AFSDB"}, {19, "X25"},
-        {20, "ISDN"}, {21, "RT"}, {22, "NSAP"}, {23, "NSAP-PTR"},
-        {24, "SIG"}, {25, "KEY"}, {26, "PX"}, {27, "GPOS"},
-        {28, "AAAA"}, {29, "LOC"}, {30, "NXT"}, {31, "EID"},
-        {32, "NIMLOC"}, {33, "SRV"}, {34, "ATMA"}, {35, "NAPTR"},
-        {36, "KX"}, {37, "CERT"}, {38, "A6"}, {39, "DNAME"},
-        {40, "SINK"}, {41, "OPT"}, {42, "APL"}, {43, "DS"},
-        {44, "SSHFP"}, {45, "IPSECKEY"}, {46, "RRSIG"}, {47, "NSEC"},
-        {48, "DNSKEY"}, {49, "DHCID"}, {50, "NSEC3"}, {51, "NSEC3PARAM"},
-        {52, "TLSA"}, {53, "SMIMEA"}, {54, "UNASSIGNED"}, {55, "HIP"},
-        {56, "NINFO"}, {57, "RKEY"}, {58, "TALINK"}, {59, "CDS"},
-        {60, "CDNSKEY"}, {61, "OPENGPKEY"}, {62, "CSYNC"}, {63, "ZONEMD"},
-        {64, "SVCB"}, {65, "HTTPS"}, {99, "SPF"}, {100, "UINFO"},
-        {101, "UID"}, {102, "GID"}, {103, "UNSPEC"}, {104, "NID"},
-        {105, "L32"}, {106, "L64"}, {107, "LP"}, {108, "EUI48"},
-        {109, "EUI64"}, {249, "TKEY"}, {250, "TSIG"}, {251, "IXFR"},
-        {252, "AXFR"}, {253, "MAILB"}, {254, "MAILA"}, {255, "*"},
-        {256, "URI"}, {257, "CAA"}, {258, "AVC"}, {259, "DOA"},
-        {260, "AMTRELAY"}, {32768, "TA"}, {32769, "DLV"}, {65535, "RESERVED"},
-    };
-    unordered_map<int, string> classMap = {
-        {0, "RESERVED"}, {1, "IN"}, {2, "UNASSIGNED"}, {3, "CH"},
-        {4, "HS"}, {254, "NONE"}, {255, "ANY"} };
-    
-    for(int i = 5; i <= 253; i++) {
-        classMap[i] = "UNASSIGNED";
-    }
-    for(int i = 256; i <= 65279; i++) {
-        classMap[i] = "UNASSIGNED";
-    }
-    for(int i = 65280; i <= 65535; i++) {
-        classMap[i] = "RESERVED";
-    }
-    for(int i = 66; i <= 98; i++) {
-        rrTypes[i] = "UNASSIGNED";
-    }
-    for(int i = 110; i <= 248; i++) {
-        rrTypes[i] = "UNASSIGNED";
-    }
-    for(int i = 261; i <= 32767; i++) {
-        rrTypes[i] = "UNASSIGNED";
-    }
-    for(int i = 32770; i <= 65279; i++) {
-        rrTypes[i] = "UNASSIGNED";
-    }
-    for(int i = 65280; i <= 65534; i++) {
-        rrTypes[i] = "PRIVATE";
-    }
-    
     string output = string();
     
     if(anCount) {
         output.append(";; ANSWER SECTION:\n");
         for(int i = 0; i < answers.size(); i++) {
-            output.append(answers[i].rName + "\t\t");
-            output.append(to_string(answers[i].rTtl) + "\t");
-            output.append(classMap[answers[i].rClass] + "\t");
-            output.append(rrTypes[answers[i].rType] + "\t");
-            output.append(answers[i].rData + "\n");
+            output.append(printableRecord(answers[i]));
         }
     }
     if(nsCount) {
         output.append(";; AUTHORITY SECTION:\n");
         for(int i = 0; i < authority.size(); i++) {
-            output.append(authority[i].rName + "\t\t");
-            output.append(to_string(authority[i].rTtl) + "\t");
-            output.append(classMap[authority[i].rClass] + "\t");
-            output.append(rrTypes[authority[i].rType] + "\t");
-            output.append(authority[i].rData + "\n");
+            output.append(printableRecord(authority[i]));
         }
     }
     if(arCount) {
         output.append(";; ADDITIONAL SECTION:\n");
         for(int i = 0; i < additional.size(); i++) {
-            output.append(additional[i].rName + "\t\t");
-            output.append(to_string(additional[i].rTtl) + "\t");
-            output.append(classMap[additional[i].rClass] + "\t");
-            output.append(rrTypes[additional[i].rType] + "\t");
-            output.append(additional[i].rData + "\n");
+            output.append(printableRecord(additional[i]));
         }
     }
     return output;
 }
 
+// Returns a single resource record as one line of text
+string DNSMessage::printableRecord(const ResourceRecord& record) {
+    string output = record.rName + "\t\t";
+    output.append(to_string(record.rTtl) + "\t");
+    output.append(className(record.rClass) + "\t");
+    output.append(typeName(record.rType) + "\t");
+    output.append(record.rData + "\n");
+    return output;
+}
+
+// Returns a string of every name tagged by the suffix list in a readable format
+string DNSMessage::printableSuffixMatches() {
+    string output = ";; SUFFIX MATCHES:\n";
+    for(int i = 0; cmp_less(i, suffixMatches.size()); i++) {
+        output.append(";" + suffixMatches[i].name + "\t\t");
+        output.append(suffixMatches[i].suffix + "\n");
+    }
+    return output;
+}
+
 // Parses the constant length header of DNS message data
 void DNSMessage::parseHeader(string& hexData, int& begin) {
     // Alternatively, could shift first then mask
@@ -320,11 +547,13 @@ void DNSMessage::parseQuestions(string& hexData, int& begin) {
     
     for(int i = 0; cmp_less(i, qdCount); i++) {
         DNSQuestion newQuery = {};
+        int nameStart = begin;
         string name = extractName(hexData, begin);
         int nameError = validateName(name);
         
         if(nameError == VALID) {
             newQuery.qName = name;
+            matchName(hexData, nameStart, name);
         }
         else {
             // Invalid name - stop parsing completely
@@ -336,7 +565,7 @@ void DNSMessage::parseQuestions(string& hexData, int& begin) {
             return;
         }
         
-        if(begin + 8 < hexData.length()) {
+        if(cmp_less_equal(begin + 8, hexData.length())) {
             newQuery.qType = stoul(hexData.substr(begin, 4), nullptr, 16);
             newQuery.qClass = stoul(hexData.substr(begin + 4, 4), nullptr, 16);
             questions.push_back(newQuery);
@@ -368,11 +597,13 @@ void DNSMessage::parseResourceRecords(string& hexData, int& begin) {
     for(int count = 0; count < 3; count++) {
         for(int i = 0; cmp_less(i, recordCounts[count]); i++) {
             ResourceRecord newRecord = {};
+            int nameStart = begin;
             string name = extractName(hexData, begin);
             int nameError = validateName(name);
 
             if (nameError == VALID) {
                 newRecord.rName = name;
+                matchName(hexData, nameStart, name);
             }
             else {
                 // Invalid name - stop parsing completely
@@ -397,7 +628,7 @@ void DNSMessage::parseResourceRecords(string& hexData, int& begin) {
                 return;
             }
             
-            if(begin + 20 < hexData.length()) {
+            if(cmp_less_equal(begin + 20, hexData.length())) {
                 newRecord.rType = stoul(hexData.substr(begin, 4), nullptr, 16);
                 newRecord.rClass = stoul(hexData.substr(begin + 4, 4), nullptr, 16);
                 newRecord.rTtl = stoi(hexData.substr(begin + 8, 8), nullptr, 16);
@@ -454,7 +685,7 @@ void DNSMessage::parseRRData(string& hexData, int& begin, ResourceRecord& dataRe
     
     if(supportedRTypes.find(dataRecord.rType) == supportedRTypes.end()) {
         dataRecord.rData = "NOT SUPPORTED";
-        begin += dataRecord.rdLength;
+        begin += dataRecord.rdLength*2;
         return;
     }
     
@@ -476,7 +707,9 @@ void DNSMessage::parseRRData(string& hexData, int& begin, ResourceRecord& dataRe
     }
     else if(dataRecord.rType == 5) {
         // Read data as a record name
+        int nameStart = begin;
         dataRecord.rData = extractName(hexData, begin);
+        matchName(hexData, nameStart, dataRecord.rData);
     }
     else if(dataRecord.rType == 16) {
         // Read data as ASCII text
@@ -563,20 +796,28 @@ void DNSMessage::parseRRData(string& hexData, int& begin, ResourceRecord& dataRe
     return;
 }
 
-// Cleans formatted hex data of other characters into a usable format
-int DNSMessage::extractRawHex(string& hexString) {
+// Decodes the input format into upper case hex data usable by the parser
+int DNSMessage::extractRawHex(string& hexString, const DNSParseOptions& options) {
     // Minimum of 12 bytes to have complete header data
     const int minLength = 24;
-    vector<char> removeChar = {' ', '"', '\\', 'x'};
+    string hexData;
 
-    // Clean input of standard characters for proper parsing
-    for(int i = 0; i < removeChar.size(); i++) {
-        hexString.erase(remove(hexString.begin(), hexString.end(), removeChar[i]), hexString.end());
+    // Decode the input into upper case hex for consistent parsing
+    bool decoded = decodeMessage(options.format, hexString, hexData);
+
+    // Hex streams may mix escaped and plain hex messages, but never fall back to another encoding
+    if(!decoded && options.mixedFormats && options.format == FORMAT_ESCAPED_HEX) {
+        decoded = decodeMessage(FORMAT_PLAIN_HEX, hexString, hexData);
     }
-    
-    // Convert string to upper case for consistency
-    transform(hexString.begin(), hexString.end(), hexString.begin(), ::toupper);
-    
+    else if(!decoded && options.mixedFormats && options.format == FORMAT_PLAIN_HEX) {
+        decoded = decodeMessage(FORMAT_ESCAPED_HEX, hexString, hexData);
+    }
+    if(!decoded) {
+        // Error: input contains characters outside of its format - return error
+        return 0;
+    }
+    hexString.swap(hexData);
+
     if(hexString.length() < minLength) {
         // Error: DNS Message has incomplete header data - return error
         return 0;
@@ -666,6 +907,38 @@ string DNSMessage::extractName(string& hexData, int& begin) {
     return name;
 }
 
+// Tags the name if it falls under an entry of the suffix list
+void DNSMessage::matchName(string& hexData, int nameStart, string& name) {
+    if(!matcher || name.empty()) {
+        return;
+    }
+
+    int matchedLabels = matcher->match(hexData, nameStart);
+    if(matchedLabels < 1) {
+        return;
+    }
+
+    // A name is only reported once, even if it appears in several records
+    for(int i = 0; cmp_less(i, suffixMatches.size()); i++) {
+        if(suffixMatches[i].name == name) {
+            return;
+        }
+    }
+
+    // Matched suffix is the last matchedLabels labels of the name
+    int suffixStart = 0;
+    int labels = 0;
+    for(int i = name.length() - 2; i >= 0; i--) {
+        if(name[i] == '.' && ++labels == matchedLabels) {
+            suffixStart = i + 1;
+            break;
+        }
+    }
+
+    SuffixMatch newMatch = {name, name.substr(suffixStart)};
+    suffixMatches.push_back(newMatch);
+}
+
 // Returns a code defined in the dnsNameError enum after validating the name passed in
 dnsNameError DNSMessage::validateName(string dnsName) {  
     const int maxNameLength = 254;
@@ -0,0 +1,661 @@
+#include <cstdio>
+#include <cstring>
+#include <DnstapReader.hpp>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+using namespace std;
+
+static const string contentType = "protobuf:dnstap.Dnstap";
+
+// Control frames are limited to 512 bytes by the Frame Streams protocol
+static const uint32_t maxControlLength = 512;
+static const uint32_t maxFrameLength = 1 << 20;
+static const uint32_t contentTypeField = 1;
+
+// Single field of a protobuf message - length delimited fields point into the message
+struct ProtobufField {
+    unsigned int number;
+    unsigned int wireType;
+    uint64_t value;
+    const unsigned char* bytes;
+    size_t length;
+};
+
+enum protobufWireType { WIRE_VARINT = 0, WIRE_FIXED64 = 1, WIRE_BYTES = 2, WIRE_FIXED32 = 5 };
+
+static inline uint32_t readUint32(const unsigned char* bytes) {
+    return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3];
+}
+
+static inline void appendUint32(vector<unsigned char>& frame, uint32_t value) {
+    frame.push_back(value >> 24);
+    frame.push_back((value >> 16) & 0xFF);
+    frame.push_back((value >> 8) & 0xFF);
+    frame.push_back(value & 0xFF);
+}
+
+// Reads a base 128 varint - returns false if it runs past the end or is longer than 64 bits
+static bool readVarint(const unsigned char*& data, const unsigned char* end, uint64_t& value) {
+    value = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        if(data == end) {
+            return false;
+        }
+        unsigned char byte = *data++;
+        value |= uint64_t(byte & 0x7F) << shift;
+        if(!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Reads the next field of a protobuf message - groups are not used by dnstap and are rejected
+static bool readField(const unsigned char*& data, const unsigned char* end, ProtobufField& field) {
+    uint64_t key;
+    if(!readVarint(data, end, key) || (key >> 3) == 0) {
+        return false;
+    }
+    field.number = key >> 3;
+    field.wireType = key & 0x07;
+    field.value = 0;
+    field.bytes = nullptr;
+    field.length = 0;
+
+    switch(field.wireType) {
+        case WIRE_VARINT:
+            return readVarint(data, end, field.value);
+        case WIRE_FIXED64:
+        case WIRE_FIXED32: {
+            size_t width = (field.wireType == WIRE_FIXED64) ? 8 : 4;
+            if(size_t(end - data) < width) {
+                return false;
+            }
+            // Fixed width values are little endian
+            for(size_t i = 0; i < width; i++) {
+                field.value |= uint64_t(data[i]) << (i * 8);
+            }
+            data += width;
+            return true;
+        }
+        case WIRE_BYTES: {
+            uint64_t length;
+            if(!readVarint(data, end, length) || length > uint64_t(end - data)) {
+                return false;
+            }
+            field.bytes = data;
+            field.length = length;
+            data += length;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// Decodes the fields of a dnstap.Message used by the parser
+static bool decodeMessageFields(const unsigned char* data, const unsigned char* end, DnstapMessage& message) {
+    uint64_t queryTimeSec = 0;
+    uint64_t queryTimeNsec = 0;
+    uint64_t responseTimeSec = 0;
+    uint64_t responseTimeNsec = 0;
+
+    while(data < end) {
+        ProtobufField field;
+        if(!readField(data, end, field)) {
+            return false;
+        }
+
+        // Known fields must have the wire type of their declaration
+        unsigned int expected = WIRE_VARINT;
+        if(field.number == 4 || field.number == 5 || field.number == 10 || field.number == 11 || field.number == 14) {
+            expected = WIRE_BYTES;
+        }
+        else if(field.number == 9 || field.number == 13) {
+            expected = WIRE_FIXED32;
+        }
+        if(field.number <= 14 && field.wireType != expected) {
+            return false;
+        }
+
+        switch(field.number) {
+            case 1:  message.type = field.value; break;
+            case 2:  message.socketFamily = field.value; break;
+            case 3:  message.socketProtocol = field.value; break;
+            case 4:  message.queryAddress = DnstapReader::printableAddress(string((const char*)field.bytes, field.length)); break;
+            case 5:  message.responseAddress = DnstapReader::printableAddress(string((const char*)field.bytes, field.length)); break;
+            case 6:  message.queryPort = field.value; break;
+            case 7:  message.responsePort = field.value; break;
+            case 8:  queryTimeSec = field.value; break;
+            case 9:  queryTimeNsec = field.value; break;
+            case 10: message.queryMessage = field.bytes; message.queryLength = field.length; break;
+            case 12: responseTimeSec = field.value; break;
+            case 13: responseTimeNsec = field.value; break;
+            case 14: message.responseMessage = field.bytes; message.responseLength = field.length; break;
+            default: break;
+        }
+    }
+
+    message.queryTime = queryTimeSec * 1000000000 + queryTimeNsec;
+    message.responseTime = responseTimeSec * 1000000000 + responseTimeNsec;
+    return true;
+}
+
+#ifndef _WIN32
+// Writes the whole buffer to a socket without raising SIGPIPE if the peer is gone
+static bool writeAll(int fd, const unsigned char* data, size_t length) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+
+    while(length > 0) {
+        ssize_t written = send(fd, data, length, flags);
+        if(written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+// Reads exactly the given number of bytes - received tells how many arrived before the stream ended
+static bool readAll(int fd, unsigned char* data, size_t length, size_t& received) {
+    received = 0;
+    while(received < length) {
+        ssize_t count = read(fd, data + received, length - received);
+        if(count <= 0) {
+            return false;
+        }
+        received += count;
+    }
+    return true;
+}
+
+// Builds a control frame, carrying the dnstap content type for READY, ACCEPT and START
+static vector<unsigned char> buildControl(unsigned int type) {
+    vector<unsigned char> frame;
+    bool typed = (type == CONTROL_READY || type == CONTROL_ACCEPT || type == CONTROL_START);
+
+    appendUint32(frame, 0);
+    appendUint32(frame, 4 + (typed ? 8 + contentType.length() : 0));
+    appendUint32(frame, type);
+    if(typed) {
+        appendUint32(frame, contentTypeField);
+        appendUint32(frame, contentType.length());
+        frame.insert(frame.end(), contentType.begin(), contentType.end());
+    }
+    return frame;
+}
+
+// Reads a control frame sent by the reader during the handshake of a replay
+static bool readControl(int fd, unsigned int& type) {
+    unsigned char header[8];
+    unsigned char payload[maxControlLength];
+    size_t received;
+
+    if(!readAll(fd, header, sizeof(header), received) || readUint32(header) != 0) {
+        return false;
+    }
+    uint32_t length = readUint32(header + 4);
+    if(length < 4 || length > maxControlLength || !readAll(fd, payload, length, received)) {
+        return false;
+    }
+    type = readUint32(payload);
+    return true;
+}
+#endif
+
+DnstapReader::DnstapReader() {
+    fileOffset = 0;
+    listenSocket = -1;
+    connection = -1;
+    started = false;
+    stopped = false;
+    frames = 0;
+    error = DNSTAP_VALID;
+}
+
+DnstapReader::~DnstapReader() {
+    close();
+}
+
+// Maps a Frame Streams file for reading - returns false if the file cannot be opened
+bool DnstapReader::openFile(const string& path) {
+    close();
+    if(!file.open(path)) {
+        return fail(DNSTAP_IO);
+    }
+    return true;
+}
+
+// Listens on a unix socket and waits for a single writer to connect
+bool DnstapReader::listen(const string& path) {
+    close();
+
+#ifndef _WIN32
+    sockaddr_un address = {};
+    if(path.length() >= sizeof(address.sun_path)) {
+        return fail(DNSTAP_IO);
+    }
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    // A socket left behind by an earlier run is replaced, any other file is kept
+    struct stat pathInfo;
+    if(stat(path.c_str(), &pathInfo) == 0) {
+        if(!S_ISSOCK(pathInfo.st_mode)) {
+            return fail(DNSTAP_IO);
+        }
+        unlink(path.c_str());
+    }
+
+    listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listenSocket < 0) {
+        return fail(DNSTAP_IO);
+    }
+    if(bind(listenSocket, (sockaddr*)&address, sizeof(address)) != 0) {
+        return fail(DNSTAP_IO);
+    }
+    socketPath = path;
+
+    if(::listen(listenSocket, 1) != 0) {
+        return fail(DNSTAP_IO);
+    }
+    connection = accept(listenSocket, nullptr, nullptr);
+    if(connection < 0) {
+        return fail(DNSTAP_IO);
+    }
+    return true;
+#else
+    return fail(DNSTAP_IO);
+#endif
+}
+
+// Reads the next dnstap message, handling any control frames before it
+// Returns false at the end of the stream, or on an error reported by getError
+bool DnstapReader::next(DnstapMessage& message) {
+    const unsigned char* payload;
+    uint32_t length;
+    bool control;
+    bool ended;
+
+    while(!stopped && error == DNSTAP_VALID) {
+        // Streams may end without a STOP frame, e.g. when a capture was cut off
+        if(!readFrame(payload, length, control, ended)) {
+            return false;
+        }
+
+        if(control) {
+            handleControl(payload, length);
+            continue;
+        }
+
+        if(!started) {
+            return fail(DNSTAP_FRAME);
+        }
+        frames++;
+
+        if(!decodeMessage(payload, length, message)) {
+            return fail(DNSTAP_PROTOBUF);
+        }
+
+        // Frames of other dnstap types carry no DNS message
+        if(message.type != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Closes the file or socket and resets the stream state
+void DnstapReader::close() {
+    file.close();
+    fileOffset = 0;
+
+#ifndef _WIN32
+    if(connection >= 0) {
+        ::close(connection);
+    }
+    if(listenSocket >= 0) {
+        ::close(listenSocket);
+        if(!socketPath.empty()) {
+            unlink(socketPath.c_str());
+        }
+    }
+#endif
+
+    connection = -1;
+    listenSocket = -1;
+    socketPath.clear();
+    started = false;
+    stopped = false;
+    frames = 0;
+    error = DNSTAP_VALID;
+}
+
+dnstapError DnstapReader::getError() {
+    return error;
+}
+
+unsigned long DnstapReader::getFrames() {
+    return frames;
+}
+
+// Decodes a dnstap.Dnstap frame - message.type stays 0 if the frame holds no dnstap.Message
+bool DnstapReader::decodeMessage(const unsigned char* data, size_t size, DnstapMessage& message) {
+    const unsigned int messageField = 14;
+    const unsigned int typeField = 15;
+    const uint64_t typeMessage = 1;
+
+    const unsigned char* end = data + size;
+    const unsigned char* messageBegin = nullptr;
+    const unsigned char* messageEnd = nullptr;
+    uint64_t frameType = 0;
+
+    message = {};
+    while(data < end) {
+        ProtobufField field;
+        if(!readField(data, end, field)) {
+            return false;
+        }
+
+        if(field.number == messageField && field.wireType == WIRE_BYTES) {
+            messageBegin = field.bytes;
+            messageEnd = field.bytes + field.length;
+        }
+        else if(field.number == typeField && field.wireType == WIRE_VARINT) {
+            frameType = field.value;
+        }
+    }
+
+    if(frameType != typeMessage || !messageBegin) {
+        return true;
+    }
+    return decodeMessageFields(messageBegin, messageEnd, message);
+}
+
+// Returns the name of a dnstap.Message type (e.g. "CLIENT_QUERY" for 5)
+string DnstapReader::typeName(unsigned int type) {
+    static const string names[] = {
+        "", "AUTH_QUERY", "AUTH_RESPONSE", "RESOLVER_QUERY", "RESOLVER_RESPONSE", "CLIENT_QUERY", "CLIENT_RESPONSE",
+        "FORWARDER_QUERY", "FORWARDER_RESPONSE", "STUB_QUERY", "STUB_RESPONSE", "TOOL_QUERY", "TOOL_RESPONSE",
+        "UPDATE_QUERY", "UPDATE_RESPONSE"
+    };
+
+    if(type >= AUTH_QUERY && type <= UPDATE_RESPONSE) {
+        return names[type];
+    }
+    return "TYPE" + to_string(type);
+}
+
+// Returns the name of a dnstap.SocketProtocol - empty if the protocol was not recorded
+string DnstapReader::protocolName(unsigned int protocol) {
+    static const string names[] = { "", "UDP", "TCP", "DOT", "DOH", "DNSCRYPT_UDP", "DNSCRYPT_TCP", "DOQ" };
+
+    if(protocol < sizeof(names) / sizeof(names[0])) {
+        return names[protocol];
+    }
+    return "PROTOCOL" + to_string(protocol);
+}
+
+// Formats a 4 byte IPv4 or 16 byte IPv6 address, compressing the longest run of zero IPv6 groups
+string DnstapReader::printableAddress(const string& address) {
+    const unsigned char* bytes = (const unsigned char*)address.data();
+    string printable = string();
+
+    if(address.length() == 4) {
+        for(int i = 0; i < 4; i++) {
+            printable += (i ? "." : "") + to_string(bytes[i]);
+        }
+        return printable;
+    }
+
+    if(address.length() != 16) {
+        return printable;
+    }
+
+    unsigned int groups[8];
+    int runStart = -1;
+    int runLength = 0;
+    for(int i = 0, start = -1; i < 8; i++) {
+        groups[i] = (bytes[i * 2] << 8) | bytes[i * 2 + 1];
+        if(groups[i] != 0) {
+            start = -1;
+            continue;
+        }
+        if(start < 0) {
+            start = i;
+        }
+        if(i - start + 1 > runLength) {
+            runStart = start;
+            runLength = i - start + 1;
+        }
+    }
+    if(runLength < 2) {
+        runStart = -1;
+    }
+
+    char group[8];
+    for(int i = 0; i < 8; i++) {
+        if(i == runStart) {
+            printable += "::";
+            i += runLength - 1;
+            continue;
+        }
+        if(!printable.empty() && printable.back() != ':') {
+            printable += ":";
+        }
+        snprintf(group, sizeof(group), "%x", groups[i]);
+        printable += group;
+    }
+    return printable;
+}
+
+// Connects to a reader, performs the READY/ACCEPT/START handshake, sends every data frame of
+// the file straight from the mapped file and ends the stream with STOP/FINISH
+bool DnstapReader::replay(const string& path, const string& socketPath, unsigned long& frames) {
+    frames = 0;
+
+#ifndef _WIN32
+    MappedFile input;
+    if(!input.open(path)) {
+        return false;
+    }
+
+    sockaddr_un address = {};
+    if(socketPath.length() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) {
+        return false;
+    }
+
+    unsigned int reply = 0;
+    vector<unsigned char> frame = buildControl(CONTROL_READY);
+    bool connected = connect(fd, (sockaddr*)&address, sizeof(address)) == 0 &&
+                     writeAll(fd, frame.data(), frame.size()) &&
+                     readControl(fd, reply) && reply == CONTROL_ACCEPT;
+    frame = buildControl(CONTROL_START);
+    if(!connected || !writeAll(fd, frame.data(), frame.size())) {
+        ::close(fd);
+        return false;
+    }
+
+    // Control frames of the file are replaced by the handshake of this connection
+    const unsigned char* data = input.data();
+    size_t size = input.size();
+    size_t offset = 0;
+    while(offset + 4 <= size) {
+        uint32_t length = readUint32(data + offset);
+        size_t frameLength = 4 + length;
+        bool control = (length == 0);
+        if(control) {
+            if(offset + 8 > size) {
+                break;
+            }
+            frameLength = 8 + readUint32(data + offset + 4);
+        }
+        if(frameLength > size - offset) {
+            break;
+        }
+
+        if(!control) {
+            if(!writeAll(fd, data + offset, frameLength)) {
+                ::close(fd);
+                return false;
+            }
+            frames++;
+        }
+        offset += frameLength;
+    }
+
+    frame = buildControl(CONTROL_STOP);
+    bool finished = writeAll(fd, frame.data(), frame.size()) && readControl(fd, reply) && reply == CONTROL_FINISH;
+    ::close(fd);
+    return finished;
+#else
+    return false;
+#endif
+}
+
+// Records the error that ended the stream - always returns false
+bool DnstapReader::fail(dnstapError reason) {
+    error = reason;
+    return false;
+}
+
+// Reads the next bytes of the stream - ended is set if the stream ended before the first byte
+bool DnstapReader::readExact(size_t length, const unsigned char*& bytes, bool& ended) {
+    if(connection < 0) {
+        ended = (fileOffset == file.size());
+        if(length > file.size() - fileOffset) {
+            return false;
+        }
+        bytes = file.data() + fileOffset;
+        fileOffset += length;
+        return true;
+    }
+
+#ifndef _WIN32
+    if(frameBuffer.size() < length) {
+        frameBuffer.resize(length);
+    }
+
+    size_t received;
+    bool complete = readAll(connection, frameBuffer.data(), length, received);
+    ended = (received == 0);
+    bytes = frameBuffer.data();
+    return complete;
+#else
+    return false;
+#endif
+}
+
+// Reads a data frame, or a control frame following an escaped zero length
+bool DnstapReader::readFrame(const unsigned char*& payload, uint32_t& length, bool& control, bool& ended) {
+    const unsigned char* bytes;
+    control = false;
+
+    if(!readExact(4, bytes, ended)) {
+        return ended ? false : fail(DNSTAP_FRAME);
+    }
+    length = readUint32(bytes);
+
+    if(length == 0) {
+        control = true;
+        if(!readExact(4, bytes, ended)) {
+            return fail(DNSTAP_FRAME);
+        }
+        length = readUint32(bytes);
+        if(length < 4 || length > maxControlLength) {
+            return fail(DNSTAP_CONTROL);
+        }
+    }
+    else if(length > maxFrameLength) {
+        return fail(DNSTAP_FRAME);
+    }
+
+    if(!readExact(length, payload, ended)) {
+        return fail(DNSTAP_FRAME);
+    }
+    return true;
+}
+
+// Follows the Frame Streams handshake - READY is answered with ACCEPT and STOP with FINISH on sockets
+bool DnstapReader::handleControl(const unsigned char* payload, uint32_t length) {
+    uint32_t type = readUint32(payload);
+    bool typed = false;
+    bool matched = false;
+
+    for(uint32_t offset = 4; offset < length;) {
+        if(length - offset < 8) {
+            return fail(DNSTAP_CONTROL);
+        }
+        uint32_t fieldType = readUint32(payload + offset);
+        uint32_t fieldLength = readUint32(payload + offset + 4);
+        offset += 8;
+        if(fieldLength > length - offset) {
+            return fail(DNSTAP_CONTROL);
+        }
+
+        if(fieldType == contentTypeField) {
+            typed = true;
+            matched = matched || string((const char*)payload + offset, fieldLength) == contentType;
+        }
+        offset += fieldLength;
+    }
+
+    if(typed && !matched) {
+        return fail(DNSTAP_CONTENT_TYPE);
+    }
+
+    bool socketStream = (connection >= 0);
+    switch(type) {
+        case CONTROL_READY:
+            if(!socketStream || started) {
+                return fail(DNSTAP_CONTROL);
+            }
+            return sendControl(CONTROL_ACCEPT);
+        case CONTROL_START:
+            if(started) {
+                return fail(DNSTAP_CONTROL);
+            }
+            started = true;
+            return true;
+        case CONTROL_STOP:
+            if(!started) {
+                return fail(DNSTAP_CONTROL);
+            }
+            stopped = true;
+            return !socketStream || sendControl(CONTROL_FINISH);
+        default:
+            return fail(DNSTAP_CONTROL);
+    }
+}
+
+// Sends a control frame to the connected writer
+bool DnstapReader::sendControl(unsigned int type) {
+#ifndef _WIN32
+    vector<unsigned char> frame = buildControl(type);
+    if(!writeAll(connection, frame.data(), frame.size())) {
+        return fail(DNSTAP_IO);
+    }
+    return true;
+#else
+    return fail(DNSTAP_IO);
+#endif
+}
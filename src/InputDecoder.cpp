@@ -0,0 +1,270 @@
+#include <cctype>
+#include <InputDecoder.hpp>
+
+using namespace std;
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+// Converts a base64 or base64url character to its value - returns -1 for any other character
+static inline int base64Value(char base64Char) {
+    if(base64Char >= 'A' && base64Char <= 'Z') {
+        return base64Char - 'A';
+    }
+    if(base64Char >= 'a' && base64Char <= 'z') {
+        return base64Char - 'a' + 26;
+    }
+    if(base64Char >= '0' && base64Char <= '9') {
+        return base64Char - '0' + 52;
+    }
+    if(base64Char == '+' || base64Char == '-') {
+        return 62;
+    }
+    if(base64Char == '/' || base64Char == '_') {
+        return 63;
+    }
+    return -1;
+}
+
+static inline bool isBlank(char blankChar) {
+    return blankChar == ' ' || blankChar == '\t' || blankChar == '\r' || blankChar == '\n';
+}
+
+static inline void appendHexByte(string& hexData, unsigned char byte) {
+    hexData += hexDigits[byte >> 4];
+    hexData += hexDigits[byte & 0x0F];
+}
+
+// Accepts "\xHH" and "xHH" byte tokens, quotes, blanks and "\" line continuations
+template<>
+bool MessageDecoder<FORMAT_ESCAPED_HEX>::decode(const string& input, string& hexData) {
+    size_t length = input.length();
+    hexData.clear();
+    hexData.reserve(length / 2);
+
+    for(size_t i = 0; i < length;) {
+        char currChar = input[i];
+
+        if(isBlank(currChar) || currChar == '"') {
+            i++;
+            continue;
+        }
+
+        if(currChar == '\\') {
+            if(i + 1 < length && (input[i + 1] == 'x' || input[i + 1] == 'X')) {
+                i++;
+                currChar = input[i];
+            }
+            else if(i + 1 == length || isBlank(input[i + 1]) || input[i + 1] == '"') {
+                // Line continuation, possibly joined with the next quoted line
+                i++;
+                continue;
+            }
+            else {
+                return false;
+            }
+        }
+
+        if((currChar != 'x' && currChar != 'X') || i + 2 >= length ||
+           hexValue(input[i + 1]) < 0 || hexValue(input[i + 2]) < 0) {
+            return false;
+        }
+
+        hexData += toupper(input[i + 1]);
+        hexData += toupper(input[i + 2]);
+        i += 3;
+    }
+
+    return true;
+}
+
+// Accepts hex digits, optionally separated by blanks
+template<>
+bool MessageDecoder<FORMAT_PLAIN_HEX>::decode(const string& input, string& hexData) {
+    hexData.clear();
+    hexData.reserve(input.length());
+
+    for(size_t i = 0; i < input.length(); i++) {
+        char currChar = input[i];
+        if(isBlank(currChar)) {
+            continue;
+        }
+        if(hexValue(currChar) < 0) {
+            return false;
+        }
+        hexData += toupper(currChar);
+    }
+
+    // Every byte needs two hex digits
+    return hexData.length() % 2 == 0;
+}
+
+// Accepts base64 and base64url with optional padding, or a DoH request containing a "dns=" parameter
+template<>
+bool MessageDecoder<FORMAT_BASE64>::decode(const string& input, string& hexData) {
+    size_t begin = 0;
+    size_t end = input.length();
+
+    size_t parameter = input.find("dns=");
+    if(parameter != string::npos) {
+        begin = parameter + 4;
+        end = input.find_first_of("& \t\r\n\"'", begin);
+        if(end == string::npos) {
+            end = input.length();
+        }
+    }
+
+    hexData.clear();
+    hexData.reserve((end - begin) * 3 / 2);
+
+    unsigned int bits = 0;
+    int bitCount = 0;
+    bool padding = false;
+    for(size_t i = begin; i < end; i++) {
+        char currChar = input[i];
+        if(isBlank(currChar)) {
+            continue;
+        }
+        if(currChar == '=') {
+            padding = true;
+            continue;
+        }
+
+        int value = base64Value(currChar);
+        if(value < 0 || padding) {
+            return false;
+        }
+
+        bits = (bits << 6) | value;
+        bitCount += 6;
+        if(bitCount >= 8) {
+            bitCount -= 8;
+            appendHexByte(hexData, (bits >> bitCount) & 0xFF);
+        }
+    }
+
+    // A single leftover character cannot hold a whole byte
+    return bitCount < 6;
+}
+
+// Accepts the bytes of a single wire format message (without its length prefix)
+template<>
+bool MessageDecoder<FORMAT_RAW_BINARY>::decode(const string& input, string& hexData) {
+    encodeHex(reinterpret_cast<const unsigned char*>(input.data()), input.length(), hexData);
+    return true;
+}
+
+void encodeHex(const unsigned char* data, size_t length, string& hexData) {
+    hexData.clear();
+    hexData.reserve(length * 2);
+
+    for(size_t i = 0; i < length; i++) {
+        appendHexByte(hexData, data[i]);
+    }
+}
+
+bool decodeMessage(inputFormat format, const string& input, string& hexData) {
+    if(format == FORMAT_AUTO) {
+        format = detectFormat(input.data(), input.length());
+    }
+
+    switch(format) {
+        case FORMAT_ESCAPED_HEX:
+            return MessageDecoder<FORMAT_ESCAPED_HEX>::decode(input, hexData);
+        case FORMAT_PLAIN_HEX:
+            return MessageDecoder<FORMAT_PLAIN_HEX>::decode(input, hexData);
+        case FORMAT_BASE64:
+            return MessageDecoder<FORMAT_BASE64>::decode(input, hexData);
+        case FORMAT_RAW_BINARY:
+            return MessageDecoder<FORMAT_RAW_BINARY>::decode(input, hexData);
+        default:
+            return false;
+    }
+}
+
+// Binary data is recognized by control characters and a plausible first length prefix, DoH logs by
+// their "dns=" parameter, and the remaining text formats by the first decoder that accepts the first line
+inputFormat detectFormat(const char* sample, size_t size) {
+    // Length prefixes make the first bytes of binary input control characters
+    const size_t binaryProbe = 512;
+    const size_t minMessageLength = 12;
+    const char byteOrderMark[] = "\xEF\xBB\xBF";
+
+    // Bytes above 0x7E are left to text detection, as they appear in UTF-8 text such as user agents
+    bool control = false;
+    for(size_t i = 0; i < size && i < binaryProbe && !control; i++) {
+        unsigned char sampleChar = sample[i];
+        control = (sampleChar < ' ' && !isBlank(sampleChar)) || sampleChar == 0x7F;
+    }
+    if(control && size >= 2) {
+        size_t firstLength = (static_cast<unsigned char>(sample[0]) << 8) | static_cast<unsigned char>(sample[1]);
+        if(firstLength >= minMessageLength) {
+            return FORMAT_RAW_BINARY;
+        }
+    }
+
+    size_t lineStart = 0;
+    if(size >= 3 && string(sample, 3) == byteOrderMark) {
+        lineStart = 3;
+    }
+    while(lineStart < size && isBlank(sample[lineStart])) {
+        lineStart++;
+    }
+    size_t lineEnd = lineStart;
+    while(lineEnd < size && sample[lineEnd] != '\r' && sample[lineEnd] != '\n') {
+        lineEnd++;
+    }
+    string firstLine = string(sample + lineStart, lineEnd - lineStart);
+
+    if(firstLine.find("dns=") != string::npos) {
+        return FORMAT_BASE64;
+    }
+
+    string decoded;
+    if(MessageDecoder<FORMAT_ESCAPED_HEX>::decode(firstLine, decoded)) {
+        return FORMAT_ESCAPED_HEX;
+    }
+    if(MessageDecoder<FORMAT_PLAIN_HEX>::decode(firstLine, decoded)) {
+        return FORMAT_PLAIN_HEX;
+    }
+
+    // Hex digits and "x" are also valid base64, so a line made only of hex characters is
+    // malformed or split hex - the hex decoders report the error instead of decoding garbage
+    if(firstLine.find_first_not_of("0123456789ABCDEFabcdefxX\"\\ \t") == string::npos) {
+        return firstLine.find_first_of("xX\\") == string::npos ? FORMAT_PLAIN_HEX : FORMAT_ESCAPED_HEX;
+    }
+    if(MessageDecoder<FORMAT_BASE64>::decode(firstLine, decoded)) {
+        return FORMAT_BASE64;
+    }
+
+    // Not decodable by any format - the hex decoder will report the error
+    return FORMAT_PLAIN_HEX;
+}
+
+inputFormat parseFormatName(const string& name, bool& valid) {
+    valid = true;
+    if(name == "escaped") {
+        return FORMAT_ESCAPED_HEX;
+    }
+    if(name == "hex") {
+        return FORMAT_PLAIN_HEX;
+    }
+    if(name == "base64") {
+        return FORMAT_BASE64;
+    }
+    if(name == "raw") {
+        return FORMAT_RAW_BINARY;
+    }
+
+    valid = (name == "auto");
+    return FORMAT_AUTO;
+}
+
+string formatName(inputFormat format) {
+    switch(format) {
+        case FORMAT_ESCAPED_HEX: return "escaped";
+        case FORMAT_PLAIN_HEX:   return "hex";
+        case FORMAT_BASE64:      return "base64";
+        case FORMAT_RAW_BINARY:  return "raw";
+        default:                 return "auto";
+    }
+}
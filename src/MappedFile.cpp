@@ -0,0 +1,84 @@
+#include <fstream>
+#include <iterator>
+#include <MappedFile.hpp>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+MappedFile::MappedFile() {
+    mapData = nullptr;
+    mapSize = 0;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+// Maps the whole file into memory - returns false if the file cannot be opened
+bool MappedFile::open(const string& path) {
+    close();
+
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+
+    struct stat fileInfo;
+    if(fstat(fd, &fileInfo) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    mapSize = fileInfo.st_size;
+    if(mapSize > 0) {
+        void* mapped = mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped == MAP_FAILED) {
+            ::close(fd);
+            mapSize = 0;
+            return false;
+        }
+        mapData = static_cast<const unsigned char*>(mapped);
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    return true;
+#else
+    ifstream file(path, ios::binary);
+    if(!file) {
+        return false;
+    }
+
+    fileData.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    mapData = fileData.data();
+    mapSize = fileData.size();
+    return true;
+#endif
+}
+
+// Releases the mapping
+void MappedFile::close() {
+#ifndef _WIN32
+    if(mapData) {
+        munmap(const_cast<unsigned char*>(mapData), mapSize);
+    }
+#endif
+    fileData.clear();
+    mapData = nullptr;
+    mapSize = 0;
+}
+
+const unsigned char* MappedFile::data() const {
+    return mapData;
+}
+
+size_t MappedFile::size() const {
+    return mapSize;
+}
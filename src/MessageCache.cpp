@@ -0,0 +1,153 @@
+#include <MessageCache.hpp>
+#include <XXHash.hpp>
+
+using namespace std;
+
+MessageCache::MessageCache(size_t cacheBytes) : maxBytes(cacheBytes) {
+    shardBytes = cacheBytes / shardCount;
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+    entryCount = 0;
+    totalBytes = 0;
+
+    for(int i = 0; i < shardCount; i++) {
+        shards[i].clockHand = 0;
+        shards[i].bytes = 0;
+    }
+}
+
+// Copies the cached message for the key into message - returns false on a miss
+bool MessageCache::lookup(const string& key, uint64_t hash, DNSMessage& message) {
+    CacheShard& shard = shards[(hash >> 48) % shardCount];
+    lock_guard<mutex> guard(shard.lock);
+
+    auto found = shard.index.find(hash);
+    if(found == shard.index.end() || shard.entries[found->second].key != key) {
+        misses++;
+        return false;
+    }
+
+    CacheEntry& entry = shard.entries[found->second];
+    entry.referenced = true;
+    message = entry.message;
+    hits++;
+    return true;
+}
+
+// Stores a copy of the parsed message, evicting entries until it fits in the shard's share of the cap
+void MessageCache::insert(const string& key, uint64_t hash, DNSMessage& message) {
+    // Approximate heap usage of the entry, including its index node
+    const size_t indexNodeBytes = 32;
+    size_t bytes = sizeof(CacheEntry) + key.capacity() + message.getMemoryUsage() + indexNodeBytes;
+
+    if(bytes > shardBytes) {
+        return;
+    }
+
+    CacheShard& shard = shards[(hash >> 48) % shardCount];
+    lock_guard<mutex> guard(shard.lock);
+
+    // Another thread may have inserted the same key (or a colliding one) first
+    auto found = shard.index.find(hash);
+    if(found != shard.index.end()) {
+        CacheEntry& entry = shard.entries[found->second];
+        shard.bytes -= entry.bytes;
+        totalBytes -= entry.bytes;
+        entryCount--;
+        entry = {};
+        shard.freeSlots.push_back(found->second);
+        shard.index.erase(found);
+    }
+
+    while(shard.bytes + bytes > shardBytes) {
+        if(!evictOne(shard)) {
+            return;
+        }
+    }
+
+    size_t slot;
+    if(!shard.freeSlots.empty()) {
+        slot = shard.freeSlots.back();
+        shard.freeSlots.pop_back();
+    }
+    else {
+        slot = shard.entries.size();
+        shard.entries.emplace_back();
+    }
+
+    CacheEntry& entry = shard.entries[slot];
+    entry.hash = hash;
+    entry.key = key;
+    entry.message = message;
+    entry.bytes = bytes;
+    entry.referenced = false;
+
+    shard.index[hash] = slot;
+    shard.bytes += bytes;
+    totalBytes += bytes;
+    entryCount++;
+}
+
+// Advances the clock hand until an entry that was not referenced since the last pass is evicted
+bool MessageCache::evictOne(CacheShard& shard) {
+    size_t slotCount = shard.entries.size();
+
+    // Two passes are enough - the first one clears every reference bit
+    for(size_t step = 0; step < slotCount * 2; step++) {
+        if(shard.clockHand >= slotCount) {
+            shard.clockHand = 0;
+        }
+
+        CacheEntry& entry = shard.entries[shard.clockHand];
+        size_t slot = shard.clockHand++;
+
+        if(entry.bytes == 0) {
+            continue;
+        }
+        if(entry.referenced) {
+            entry.referenced = false;
+            continue;
+        }
+
+        shard.index.erase(entry.hash);
+        shard.bytes -= entry.bytes;
+        totalBytes -= entry.bytes;
+        entryCount--;
+        evictions++;
+        entry = {};
+        shard.freeSlots.push_back(slot);
+        return true;
+    }
+
+    return false;
+}
+
+// Hashes a cache key with the 64 bit xxHash algorithm
+uint64_t MessageCache::hashKey(const string& key) {
+    return xxHash64(key);
+}
+
+unsigned long MessageCache::getHits() const {
+    return hits;
+}
+
+unsigned long MessageCache::getMisses() const {
+    return misses;
+}
+
+unsigned long MessageCache::getEvictions() const {
+    return evictions;
+}
+
+unsigned long MessageCache::getEntries() const {
+    return entryCount;
+}
+
+size_t MessageCache::getBytes() const {
+    return totalBytes;
+}
+
+size_t MessageCache::getMaxBytes() const {
+    return maxBytes;
+}
@@ -0,0 +1,363 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <utility>
+#include <QueryCorrelator.hpp>
+
+using namespace std;
+
+bool CorrelationKey::operator==(const CorrelationKey& other) const {
+    return id == other.id && qType == other.qType && port == other.port &&
+           qName == other.qName && client == other.client;
+}
+
+size_t CorrelationKeyHash::operator()(const CorrelationKey& key) const {
+    size_t hash = std::hash<string>()(key.qName);
+    hash ^= std::hash<string>()(key.client) + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    hash ^= ((size_t)key.id << 32 | (size_t)key.port << 16 | key.qType) * 0x9E3779B97F4A7C15ULL;
+    return hash;
+}
+
+TimingWheel::TimingWheel() {
+    for(int level = 0; level < levels; level++) {
+        for(int slot = 0; slot < slotCount; slot++) {
+            slots[level][slot] = nullptr;
+        }
+    }
+    currentTick = 0;
+    entryCount = 0;
+}
+
+// Sets the tick the wheel starts turning from
+void TimingWheel::start(uint64_t tick) {
+    currentTick = tick;
+}
+
+// Adds an entry to the wheel - entries that are already due expire on the next tick
+void TimingWheel::schedule(PendingQuery* entry) {
+    if(entry->expiryTick <= currentTick) {
+        entry->expiryTick = currentTick + 1;
+    }
+    link(entry);
+}
+
+// Links the entry into the lowest level whose span still contains its expiry tick
+void TimingWheel::link(PendingQuery* entry) {
+    // Entries beyond the range of the top level are placed there and rescheduled when it turns
+    int level = 0;
+    while(level < levels - 1 &&
+          (entry->expiryTick >> (slotBits * (level + 1))) != (currentTick >> (slotBits * (level + 1)))) {
+        level++;
+    }
+
+    entry->level = level;
+    entry->slot = (entry->expiryTick >> (slotBits * level)) & (slotCount - 1);
+    entry->prev = nullptr;
+    entry->next = slots[level][entry->slot];
+    if(entry->next) {
+        entry->next->prev = entry;
+    }
+    slots[level][entry->slot] = entry;
+    entryCount++;
+}
+
+// Unlinks the entry from its slot
+void TimingWheel::cancel(PendingQuery* entry) {
+    if(entry->prev) {
+        entry->prev->next = entry->next;
+    }
+    else {
+        slots[entry->level][entry->slot] = entry->next;
+    }
+    if(entry->next) {
+        entry->next->prev = entry->prev;
+    }
+    entry->prev = nullptr;
+    entry->next = nullptr;
+    entryCount--;
+}
+
+// Turns the wheel up to the given tick and collects every entry that expired on the way
+void TimingWheel::advance(uint64_t tick, vector<PendingQuery*>& expired) {
+    while(currentTick < tick) {
+        if(entryCount == 0) {
+            // Nothing can expire - jump straight to the target
+            currentTick = tick;
+            return;
+        }
+
+        // Ticks before the next occupied slot would neither cascade nor expire anything
+        uint64_t nextTick = nextEventTick();
+        if(nextTick > tick) {
+            currentTick = tick;
+            return;
+        }
+        currentTick = nextTick;
+
+        // Bring entries down from every level whose span just started, highest first
+        int topLevel = 0;
+        while(topLevel < levels - 1 && (currentTick & ((1ULL << (slotBits * (topLevel + 1))) - 1)) == 0) {
+            topLevel++;
+        }
+        for(int level = topLevel; level > 0; level--) {
+            cascade(level);
+        }
+
+        int slot = currentTick & (slotCount - 1);
+        PendingQuery* entry = slots[0][slot];
+        slots[0][slot] = nullptr;
+        while(entry) {
+            PendingQuery* next = entry->next;
+            entry->prev = nullptr;
+            entry->next = nullptr;
+            entryCount--;
+            expired.push_back(entry);
+            entry = next;
+        }
+    }
+}
+
+// Reschedules the entries of the current slot of a level into the levels below it
+void TimingWheel::cascade(int level) {
+    int slot = (currentTick >> (slotBits * level)) & (slotCount - 1);
+    PendingQuery* entry = slots[level][slot];
+    slots[level][slot] = nullptr;
+
+    while(entry) {
+        PendingQuery* next = entry->next;
+        entryCount--;
+        link(entry);
+        entry = next;
+    }
+}
+
+// Returns the first tick after the current one at which an occupied slot cascades or expires
+// Below the top level an entry's slot always lies ahead of the current one in the same rotation
+uint64_t TimingWheel::nextEventTick() const {
+    for(int level = 0; level < levels; level++) {
+        int shift = slotBits * level;
+        uint64_t rotation = (currentTick >> (shift + slotBits)) << (shift + slotBits);
+        int current = (currentTick >> shift) & (slotCount - 1);
+
+        for(int slot = current + 1; slot < slotCount; slot++) {
+            if(slots[level][slot]) {
+                return rotation + ((uint64_t)slot << shift);
+            }
+        }
+
+        // Entries beyond the range of the top level wait for its next rotation
+        if(level == levels - 1) {
+            for(int slot = 0; slot <= current; slot++) {
+                if(slots[level][slot]) {
+                    return rotation + ((uint64_t)(slotCount + slot) << shift);
+                }
+            }
+        }
+    }
+
+    return UINT64_MAX;
+}
+
+uint64_t TimingWheel::getTick() const {
+    return currentTick;
+}
+
+LatencyHistogram::LatencyHistogram() : buckets(bucketCount, 0) {
+    count = 0;
+    total = 0;
+    maximum = 0;
+}
+
+// Adds a single latency to the histogram
+void LatencyHistogram::record(uint64_t latency) {
+    buckets[bucketIndex(latency)]++;
+    count++;
+    total += latency;
+    maximum = max(maximum, latency);
+}
+
+// Adds every value of another histogram to this one
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for(int i = 0; i < bucketCount; i++) {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    total += other.total;
+    maximum = max(maximum, other.maximum);
+}
+
+// Returns the latency below which the given percent of values fall
+uint64_t LatencyHistogram::percentile(double percent) const {
+    if(count == 0) {
+        return 0;
+    }
+
+    uint64_t target = max<uint64_t>(1, ceil(percent / 100.0 * count));
+    uint64_t seen = 0;
+    for(int i = 0; i < bucketCount; i++) {
+        seen += buckets[i];
+        if(seen >= target) {
+            return min(bucketValue(i), maximum);
+        }
+    }
+    return maximum;
+}
+
+uint64_t LatencyHistogram::getCount() const {
+    return count;
+}
+
+uint64_t LatencyHistogram::getMax() const {
+    return maximum;
+}
+
+uint64_t LatencyHistogram::getMean() const {
+    return count ? total / count : 0;
+}
+
+// Values below 16 have a bucket each, larger values share a bucket with values of the same top 5 bits
+int LatencyHistogram::bucketIndex(uint64_t value) {
+    const uint64_t subBuckets = 1 << subBucketBits;
+
+    if(value < subBuckets) {
+        return value;
+    }
+
+    int highBit = bit_width(value) - 1;
+    int subBucket = (value >> (highBit - subBucketBits)) - subBuckets;
+    return ((highBit - subBucketBits + 1) << subBucketBits) + subBucket;
+}
+
+// Returns the midpoint of the values that fall into a bucket
+uint64_t LatencyHistogram::bucketValue(int index) {
+    const int subBuckets = 1 << subBucketBits;
+
+    if(index < subBuckets) {
+        return index;
+    }
+
+    int highBit = (index >> subBucketBits) + subBucketBits - 1;
+    uint64_t width = 1ULL << (highBit - subBucketBits);
+    uint64_t lowest = (uint64_t)(subBuckets + (index & (subBuckets - 1))) << (highBit - subBucketBits);
+    return lowest + width / 2;
+}
+
+QueryCorrelator::QueryCorrelator(uint64_t queryTimeout, unsigned long maxOutstanding) : timeout(queryTimeout) {
+    maxShardOutstanding = max(1UL, maxOutstanding / shardCount);
+
+    for(int i = 0; i < shardCount; i++) {
+        shards[i].started = false;
+        shards[i].queries = 0;
+        shards[i].responses = 0;
+        shards[i].matched = 0;
+        shards[i].timeouts = 0;
+        shards[i].unmatched = 0;
+        shards[i].dropped = 0;
+    }
+}
+
+// Records a query or matches a response to its query (time in nanoseconds)
+// Returns true and fills pair when a response answers an outstanding query
+bool QueryCorrelator::observe(DNSMessage& message, const string& client, unsigned int port, uint64_t time, CorrelatedPair& pair) {
+    const vector<DNSQuestion>& questions = message.getQuestions();
+    if(questions.empty()) {
+        return false;
+    }
+
+    CorrelationKey key = {client, port, message.getID(), questions[0].qName, questions[0].qType};
+    transform(key.qName.begin(), key.qName.end(), key.qName.begin(), ::tolower);
+
+    CorrelatorShard& shard = shards[CorrelationKeyHash()(key) % shardCount];
+    lock_guard<mutex> guard(shard.lock);
+
+    if(!shard.started) {
+        shard.wheel.start(time / tickLength);
+        shard.started = true;
+    }
+    expire(shard, time);
+
+    if(!message.getFlags().QR) {
+        shard.queries++;
+
+        // Table is full - keep memory bounded by not tracking the query
+        if(shard.pending.size() >= maxShardOutstanding) {
+            shard.dropped++;
+            return false;
+        }
+
+        auto inserted = shard.pending.try_emplace(key);
+        if(!inserted.second) {
+            // Retransmission - latency is measured from the first query
+            return false;
+        }
+
+        PendingQuery& query = inserted.first->second;
+        query.key = key;
+        query.queryTime = time;
+        query.expiryTick = (time + timeout) / tickLength;
+        shard.wheel.schedule(&query);
+        return false;
+    }
+
+    shard.responses++;
+
+    auto found = shard.pending.find(key);
+    if(found == shard.pending.end()) {
+        shard.unmatched++;
+        return false;
+    }
+
+    PendingQuery& query = found->second;
+    pair.key = key;
+    pair.queryTime = query.queryTime;
+    pair.responseTime = time;
+    pair.latency = (time > query.queryTime) ? time - query.queryTime : 0;
+    pair.rcode = message.getFlags().RCODE;
+
+    shard.wheel.cancel(&query);
+    shard.pending.erase(found);
+    shard.matched++;
+    shard.latencies.record(pair.latency);
+    return true;
+}
+
+// Expires outstanding queries in every shard up to the given time
+void QueryCorrelator::advance(uint64_t time) {
+    for(int i = 0; i < shardCount; i++) {
+        lock_guard<mutex> guard(shards[i].lock);
+        if(shards[i].started) {
+            expire(shards[i], time);
+        }
+    }
+}
+
+// Returns the totals of every shard - queries still outstanding are reported as such
+CorrelationStats QueryCorrelator::getStats() {
+    CorrelationStats stats = {};
+
+    for(int i = 0; i < shardCount; i++) {
+        lock_guard<mutex> guard(shards[i].lock);
+        stats.queries += shards[i].queries;
+        stats.responses += shards[i].responses;
+        stats.matched += shards[i].matched;
+        stats.timeouts += shards[i].timeouts;
+        stats.unmatched += shards[i].unmatched;
+        stats.dropped += shards[i].dropped;
+        stats.outstanding += shards[i].pending.size();
+        stats.latencies.merge(shards[i].latencies);
+    }
+
+    return stats;
+}
+
+// Removes every query of the shard whose timeout has passed - the shard must be locked
+void QueryCorrelator::expire(CorrelatorShard& shard, uint64_t time) {
+    vector<PendingQuery*> expired;
+    shard.wheel.advance(time / tickLength, expired);
+
+    for(int i = 0; cmp_less(i, expired.size()); i++) {
+        CorrelationKey key = expired[i]->key;
+        shard.pending.erase(key);
+        shard.timeouts++;
+    }
+}
@@ -0,0 +1,486 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <unordered_set>
+#include <utility>
+#include <RecordStore.hpp>
+#include <XXHash.hpp>
+
+using namespace std;
+
+// Identifies segment and index files
+static const char segmentMagic[8] = {'D', 'N', 'S', 'S', 'E', 'G', '0', '1'};
+static const char indexMagic[8] = {'D', 'N', 'S', 'I', 'D', 'X', '0', '1'};
+
+template<typename T>
+static void putValue(string& buffer, T value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Appends text with a one byte length prefix - names are never longer than 255 bytes
+static void putName(string& buffer, const string& name) {
+    uint8_t length = min<size_t>(name.length(), UINT8_MAX);
+    putValue(buffer, length);
+    buffer.append(name, 0, length);
+}
+
+// Appends text with a two byte length prefix
+static void putText(string& buffer, const string& text) {
+    uint16_t length = min<size_t>(text.length(), UINT16_MAX);
+    putValue(buffer, length);
+    buffer.append(text, 0, length);
+}
+
+// Reads a value at the cursor - returns false if it would read past the end
+template<typename T>
+static bool getValue(const unsigned char* data, uint64_t end, uint64_t& cursor, T& value) {
+    if(cursor + sizeof(value) > end) {
+        return false;
+    }
+    memcpy(&value, data + cursor, sizeof(value));
+    cursor += sizeof(value);
+    return true;
+}
+
+// Reads length prefixed text at the cursor, with a prefix of type T
+template<typename T>
+static bool getText(const unsigned char* data, uint64_t end, uint64_t& cursor, string& text) {
+    T length;
+    if(!getValue(data, end, cursor, length) || cursor + length > end) {
+        return false;
+    }
+    text.assign(reinterpret_cast<const char*>(data + cursor), length);
+    cursor += length;
+    return true;
+}
+
+// Packs header flags back into their wire format bit positions
+static uint16_t encodeFlags(const DNSFlags& flags) {
+    return (flags.QR << 15) | (flags.OPCODE << 11) | (flags.AA << 10) | (flags.TC << 9) |
+           (flags.RD << 8) | (flags.RA << 7) | (flags.Z << 4) | flags.RCODE;
+}
+
+static DNSFlags decodeFlags(uint16_t bits) {
+    DNSFlags flags = {};
+    flags.QR = (bits >> 15) & 0x1;
+    flags.OPCODE = (bits >> 11) & 0xF;
+    flags.AA = (bits >> 10) & 0x1;
+    flags.TC = (bits >> 9) & 0x1;
+    flags.RD = (bits >> 8) & 0x1;
+    flags.RA = (bits >> 7) & 0x1;
+    flags.Z = (bits >> 4) & 0x7;
+    flags.RCODE = bits & 0xF;
+    return flags;
+}
+
+// Returns the name in lower case, ending with the root label
+static string normalizeName(string name) {
+    transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if(name.empty() || name.back() != '.') {
+        name += '.';
+    }
+    return name;
+}
+
+// Adds index entries for every distinct name of a record and for every parent domain of them
+static void addIndexEntries(vector<string>& names, uint64_t offset, vector<StoreIndexEntry>& entries) {
+    unordered_set<uint64_t> hashes;
+
+    for(int i = 0; cmp_less(i, names.size()); i++) {
+        // Parsing errors are stored as text, not as names
+        if(names[i].empty() || names[i].back() != '.' || names[i].find(' ') != string::npos) {
+            continue;
+        }
+
+        string name = normalizeName(names[i]);
+        hashes.insert(RecordStoreReader::nameHash(name, false));
+
+        // Parents exclude the root label ("www.example.com." -> "example.com.", "com.")
+        for(size_t dot = name.find('.'); dot != string::npos && dot + 1 < name.length(); dot = name.find('.', dot + 1)) {
+            hashes.insert(RecordStoreReader::nameHash(name.substr(dot + 1), true));
+        }
+    }
+
+    for(uint64_t hash : hashes) {
+        entries.push_back({hash, offset});
+    }
+}
+
+// Collects the question and record owner names of a stored record
+static void recordNames(StoredRecord& record, vector<string>& names) {
+    vector<ResourceRecord>* sections[3] = {&record.answers, &record.authority, &record.additional};
+
+    for(int i = 0; cmp_less(i, record.questions.size()); i++) {
+        names.push_back(record.questions[i].qName);
+    }
+    for(int count = 0; count < 3; count++) {
+        for(int i = 0; cmp_less(i, sections[count]->size()); i++) {
+            names.push_back((*sections[count])[i].rName);
+        }
+    }
+}
+
+static bool entryLess(const StoreIndexEntry& left, const StoreIndexEntry& right) {
+    return left.hash != right.hash ? left.hash < right.hash : left.offset < right.offset;
+}
+
+// Walks the complete index runs that match the segment, setting covered to the segment size they index
+// Returns the size of the index file taken by those runs - anything after it is a partially written run
+static uint64_t readIndexRuns(const unsigned char* data, size_t size, uint64_t segmentSize, uint64_t& covered, vector<StoreIndexRun>* runs) {
+    uint64_t offset = 0;
+
+    while(size - offset >= sizeof(StoreIndexHeader)) {
+        StoreIndexHeader header;
+        memcpy(&header, data + offset, sizeof(header));
+        if(memcmp(header.magic, indexMagic, sizeof(indexMagic)) != 0 ||
+           header.entryCount > (size - offset - sizeof(header)) / sizeof(StoreIndexEntry) ||
+           header.segmentBytes < covered || header.segmentBytes > segmentSize) {
+            break;
+        }
+
+        if(runs) {
+            runs->push_back({reinterpret_cast<const StoreIndexEntry*>(data + offset + sizeof(header)), header.entryCount});
+        }
+        covered = header.segmentBytes;
+        offset += sizeof(header) + header.entryCount * sizeof(StoreIndexEntry);
+    }
+
+    return offset;
+}
+
+RecordStore::RecordStore() {
+    segmentBytes = 0;
+    indexedBytes = 0;
+}
+
+RecordStore::~RecordStore() {
+    close();
+}
+
+// Opens a segment file for appending, creating it if it does not exist
+// Only records written after the last index run (e.g. before a crash) are read and indexed again
+bool RecordStore::open(const string& path) {
+    close();
+    segmentPath = path;
+    index.clear();
+
+    error_code error;
+    string indexPath = path + ".idx";
+    uint64_t existingBytes = filesystem::exists(path, error) ? filesystem::file_size(path, error) : 0;
+
+    if(existingBytes > 0) {
+        MappedFile existing;
+        if(!existing.open(path) || existing.size() < sizeof(segmentMagic) ||
+           memcmp(existing.data(), segmentMagic, sizeof(segmentMagic)) != 0) {
+            return false;
+        }
+
+        uint64_t covered = sizeof(segmentMagic);
+        MappedFile existingIndex;
+        if(existingIndex.open(indexPath)) {
+            uint64_t runBytes = readIndexRuns(existingIndex.data(), existingIndex.size(), existing.size(), covered, nullptr);
+
+            // Drop a partially written run, so the next run starts at a run boundary
+            if(runBytes < existingIndex.size()) {
+                existingIndex.close();
+                filesystem::resize_file(indexPath, runBytes, error);
+                if(error) {
+                    return false;
+                }
+            }
+        }
+        indexedBytes = covered;
+
+        segmentBytes = RecordStoreReader::scanSegment(existing.data(), existing.size(), covered, index);
+
+        // Drop a partially written record at the end of the segment
+        if(segmentBytes < existing.size()) {
+            existing.close();
+            filesystem::resize_file(path, segmentBytes, error);
+            if(error) {
+                return false;
+            }
+        }
+
+        segment.open(path, ios::binary | ios::app);
+    }
+    else {
+        // An index left from an earlier segment of the same name does not describe the new one
+        filesystem::remove(indexPath, error);
+
+        segment.open(path, ios::binary | ios::trunc);
+        segment.write(segmentMagic, sizeof(segmentMagic));
+        segmentBytes = sizeof(segmentMagic);
+        indexedBytes = segmentBytes;
+    }
+
+    return segment.good();
+}
+
+// Appends a parsed message to the segment and indexes its names
+bool RecordStore::append(DNSMessage& message, uint64_t timestamp) {
+    const vector<DNSQuestion>& questions = message.getQuestions();
+    const vector<ResourceRecord>* sections[3] = {&message.getAnswers(), &message.getAuthority(), &message.getAdditional()};
+    vector<string> names;
+    string buffer = string();
+
+    if(!segment.is_open()) {
+        return false;
+    }
+
+    // Record length is filled in once the record is complete
+    putValue<uint32_t>(buffer, 0);
+    putValue<uint64_t>(buffer, timestamp);
+    putValue<uint16_t>(buffer, message.getID());
+    putValue<uint16_t>(buffer, encodeFlags(message.getFlags()));
+    putValue<uint16_t>(buffer, message.getQDCount());
+    putValue<uint16_t>(buffer, message.getANCount());
+    putValue<uint16_t>(buffer, message.getNSCount());
+    putValue<uint16_t>(buffer, message.getARCount());
+    putValue<uint16_t>(buffer, min<size_t>(questions.size(), UINT16_MAX));
+    putValue<uint16_t>(buffer, min<size_t>(sections[0]->size() + sections[1]->size() + sections[2]->size(), UINT16_MAX));
+
+    for(int i = 0; cmp_less(i, questions.size()) && i < UINT16_MAX; i++) {
+        putName(buffer, questions[i].qName);
+        putValue<uint16_t>(buffer, questions[i].qType);
+        putValue<uint16_t>(buffer, questions[i].qClass);
+        names.push_back(questions[i].qName);
+    }
+
+    int stored = 0;
+    for(int count = 0; count < 3; count++) {
+        for(int i = 0; cmp_less(i, sections[count]->size()) && stored < UINT16_MAX; i++, stored++) {
+            const ResourceRecord& record = (*sections[count])[i];
+            putValue<uint8_t>(buffer, count);
+            putName(buffer, record.rName);
+            putValue<uint16_t>(buffer, record.rType);
+            putValue<uint16_t>(buffer, record.rClass);
+            putValue<int32_t>(buffer, record.rTtl);
+            putText(buffer, record.rData);
+            names.push_back(record.rName);
+        }
+    }
+
+    uint32_t length = buffer.length() - sizeof(uint32_t);
+    memcpy(buffer.data(), &length, sizeof(length));
+
+    segment.write(buffer.data(), buffer.length());
+    if(!segment.good()) {
+        return false;
+    }
+
+    addIndexEntries(names, segmentBytes, index);
+    segmentBytes += buffer.length();
+    return true;
+}
+
+// Flushes the segment and appends the sorted entries of this session to the index as a new run
+bool RecordStore::close() {
+    if(!segment.is_open()) {
+        return true;
+    }
+
+    segment.close();
+    if(segment.fail()) {
+        return false;
+    }
+    if(segmentBytes == indexedBytes) {
+        return true;
+    }
+
+    sort(index.begin(), index.end(), entryLess);
+
+    StoreIndexHeader header;
+    memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.entryCount = index.size();
+    header.segmentBytes = segmentBytes;
+
+    // A run cut short by a crash fails the size check of the next open and is dropped there
+    ofstream indexOutput(segmentPath + ".idx", ios::binary | ios::app);
+    indexOutput.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    indexOutput.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(StoreIndexEntry));
+    indexOutput.close();
+
+    indexedBytes = segmentBytes;
+    index.clear();
+    return !indexOutput.fail();
+}
+
+RecordStoreReader::RecordStoreReader() {
+}
+
+// Maps a segment file and its index - records not covered by an index run are indexed in memory
+bool RecordStoreReader::open(const string& path) {
+    runs.clear();
+    tailEntries.clear();
+
+    if(!segment.open(path) || segment.size() < sizeof(segmentMagic) ||
+       memcmp(segment.data(), segmentMagic, sizeof(segmentMagic)) != 0) {
+        return false;
+    }
+
+    uint64_t covered = sizeof(segmentMagic);
+    if(indexFile.open(path + ".idx")) {
+        readIndexRuns(indexFile.data(), indexFile.size(), segment.size(), covered, &runs);
+    }
+
+    scanSegment(segment.data(), segment.size(), covered, tailEntries);
+    sort(tailEntries.begin(), tailEntries.end(), entryLess);
+    runs.push_back({tailEntries.data(), tailEntries.size()});
+    return true;
+}
+
+// Finds every record containing the name (or, for suffix lookups, a name below it)
+void RecordStoreReader::find(const string& name, bool suffix, vector<StoredRecord>& results) {
+    string target = normalizeName(name);
+    vector<uint64_t> offsets;
+
+    // Every run is sorted on its own, so each one is searched
+    for(int i = 0; cmp_less(i, runs.size()); i++) {
+        const StoreIndexEntry* begin = runs[i].entries;
+        const StoreIndexEntry* end = begin + runs[i].entryCount;
+        findEntries(begin, end, nameHash(target, false), offsets);
+        if(suffix) {
+            findEntries(begin, end, nameHash(target, true), offsets);
+        }
+    }
+
+    sort(offsets.begin(), offsets.end());
+    offsets.erase(unique(offsets.begin(), offsets.end()), offsets.end());
+
+    for(int i = 0; cmp_less(i, offsets.size()); i++) {
+        StoredRecord record;
+        uint64_t next;
+        if(!decodeRecord(segment.data(), segment.size(), offsets[i], record, next)) {
+            continue;
+        }
+
+        // Hash collisions are filtered out by comparing the names themselves
+        vector<string> names;
+        recordNames(record, names);
+        bool matched = false;
+        for(int j = 0; cmp_less(j, names.size()) && !matched; j++) {
+            string stored = normalizeName(names[j]);
+            if(stored == target) {
+                matched = true;
+            }
+            else if(suffix && stored.length() > target.length() &&
+                    stored.compare(stored.length() - target.length(), target.length(), target) == 0 &&
+                    stored[stored.length() - target.length() - 1] == '.') {
+                matched = true;
+            }
+        }
+
+        if(matched) {
+            results.push_back(record);
+        }
+    }
+}
+
+// Returns the offsets of every index entry with the given hash
+void RecordStoreReader::findEntries(const StoreIndexEntry* begin, const StoreIndexEntry* end, uint64_t hash, vector<uint64_t>& offsets) {
+    if(!begin) {
+        return;
+    }
+
+    StoreIndexEntry target = {hash, 0};
+    for(const StoreIndexEntry* entry = lower_bound(begin, end, target, entryLess); entry != end && entry->hash == hash; entry++) {
+        offsets.push_back(entry->offset);
+    }
+}
+
+// Hashes a normalized name for the index - suffix entries use a different prefix than exact names
+uint64_t RecordStoreReader::nameHash(const string& name, bool suffix) {
+    return xxHash64((suffix ? "~" : "=") + name);
+}
+
+// Decodes the record at offset - returns false if it is incomplete or malformed
+bool RecordStoreReader::decodeRecord(const unsigned char* data, size_t size, uint64_t offset, StoredRecord& record, uint64_t& next) {
+    uint64_t cursor = offset;
+    uint32_t length;
+    uint16_t value;
+    uint16_t questionCount;
+    uint16_t recordCount;
+
+    if(!getValue(data, size, cursor, length) || cursor + length > size) {
+        return false;
+    }
+    uint64_t end = cursor + length;
+
+    record = {};
+    record.offset = offset;
+    if(!getValue(data, end, cursor, record.timestamp) || !getValue(data, end, cursor, value)) {
+        return false;
+    }
+    record.dnsID = value;
+    if(!getValue(data, end, cursor, value)) {
+        return false;
+    }
+    record.headerFlags = decodeFlags(value);
+    for(int i = 0; i < 4; i++) {
+        if(!getValue(data, end, cursor, value)) {
+            return false;
+        }
+        record.counts[i] = value;
+    }
+    if(!getValue(data, end, cursor, questionCount) || !getValue(data, end, cursor, recordCount)) {
+        return false;
+    }
+
+    for(int i = 0; i < questionCount; i++) {
+        DNSQuestion question = {};
+        uint16_t qType;
+        uint16_t qClass;
+        if(!getText<uint8_t>(data, end, cursor, question.qName) ||
+           !getValue(data, end, cursor, qType) || !getValue(data, end, cursor, qClass)) {
+            return false;
+        }
+        question.qType = qType;
+        question.qClass = qClass;
+        record.questions.push_back(question);
+    }
+
+    vector<ResourceRecord>* sections[3] = {&record.answers, &record.authority, &record.additional};
+    for(int i = 0; i < recordCount; i++) {
+        ResourceRecord resource = {};
+        uint8_t section;
+        uint16_t rType;
+        uint16_t rClass;
+        int32_t rTtl;
+        if(!getValue(data, end, cursor, section) || section > 2 ||
+           !getText<uint8_t>(data, end, cursor, resource.rName) ||
+           !getValue(data, end, cursor, rType) || !getValue(data, end, cursor, rClass) ||
+           !getValue(data, end, cursor, rTtl) || !getText<uint16_t>(data, end, cursor, resource.rData)) {
+            return false;
+        }
+        resource.rType = rType;
+        resource.rClass = rClass;
+        resource.rTtl = rTtl;
+        resource.rdLength = resource.rData.length();
+        sections[section]->push_back(resource);
+    }
+
+    next = end;
+    return true;
+}
+
+// Indexes every complete record from begin to the end of the segment
+// Returns the offset after the last complete record
+uint64_t RecordStoreReader::scanSegment(const unsigned char* data, size_t size, uint64_t begin, vector<StoreIndexEntry>& entries) {
+    uint64_t offset = begin;
+
+    while(offset < size) {
+        StoredRecord record;
+        uint64_t next;
+        if(!decodeRecord(data, size, offset, record, next)) {
+            break;
+        }
+
+        vector<string> names;
+        recordNames(record, names);
+        addIndexEntries(names, offset, entries);
+        offset = next;
+    }
+
+    return offset;
+}
@@ -0,0 +1,384 @@
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cctype>
+#include <utility>
+#include <SuffixMatcher.hpp>
+#include <InputDecoder.hpp>
+
+using namespace std;
+
+// Identifies a compiled suffix list image
+static const char suffixImageMagic[8] = {'D', 'N', 'S', 'S', 'F', 'X', '0', '1'};
+
+// Reads the byte encoded by two hex characters - returns -1 on invalid characters
+static inline int hexByte(const string& hexData, int begin) {
+    int high = hexValue(hexData[begin]);
+    int low = hexValue(hexData[begin + 1]);
+    if(high < 0 || low < 0) {
+        return -1;
+    }
+    return (high << 4) | low;
+}
+
+SuffixMatcher::SuffixMatcher() {
+    nodes = nullptr;
+    edges = nullptr;
+    labels = nullptr;
+    nodeCount = 0;
+    edgeCount = 0;
+    labelBytes = 0;
+}
+
+// Loads a compiled image (memory-mapped) or compiles a plain text list in memory
+bool SuffixMatcher::load(const string& path) {
+    if(!mappedImage.open(path)) {
+        return false;
+    }
+
+    if(mappedImage.size() >= sizeof(SuffixImageHeader) &&
+       memcmp(mappedImage.data(), suffixImageMagic, sizeof(suffixImageMagic)) == 0) {
+        return attachImage(mappedImage.data(), mappedImage.size());
+    }
+
+    // Not an image - treat the file as a list of domains
+    mappedImage.close();
+    unsigned long entries = 0;
+    if(!buildImage(path, builtImage, entries)) {
+        return false;
+    }
+    return attachImage(builtImage.data(), builtImage.size());
+}
+
+// Compiles a list of domains (one per line) into an image file that can be memory-mapped
+bool SuffixMatcher::compileList(const string& listPath, const string& imagePath, unsigned long& entries) {
+    vector<unsigned char> image;
+    if(!buildImage(listPath, image, entries)) {
+        return false;
+    }
+
+    ofstream imageFile(imagePath, ios::binary | ios::trunc);
+    if(!imageFile) {
+        return false;
+    }
+    imageFile.write(reinterpret_cast<const char*>(image.data()), image.size());
+    return imageFile.good();
+}
+
+// Returns true if no image is loaded
+bool SuffixMatcher::empty() const {
+    return nodeCount == 0;
+}
+
+// Matches the wire format name starting at begin (in hex data) against the list
+// Returns the number of trailing labels that matched a list entry, or 0 if there is no match
+int SuffixMatcher::match(const string& hexData, int begin) const {
+    int labelStart[maxLabels];
+    unsigned int labelLength[maxLabels];
+    int labelCount = 0;
+    int jumps = 0;
+    int hexLength = hexData.length();
+
+    if(nodeCount == 0 || begin < 0) {
+        return 0;
+    }
+
+    // Collect label locations without building a string, following compression pointers
+    while(true) {
+        if(begin + 1 >= hexLength) {
+            return 0;
+        }
+
+        int length = hexByte(hexData, begin);
+        if(length < 0) {
+            return 0;
+        }
+        if((length & 0xC0) == 0xC0) {
+            if(begin + 3 >= hexLength || ++jumps > maxLabels) {
+                return 0;
+            }
+            int low = hexByte(hexData, begin + 2);
+            if(low < 0) {
+                return 0;
+            }
+            begin = (((length & 0x3F) << 8) | low) * 2;
+            continue;
+        }
+        if(length == 0) {
+            break;
+        }
+        if(length > 63 || labelCount == maxLabels || begin + 2 + length * 2 > hexLength) {
+            return 0;
+        }
+
+        labelStart[labelCount] = begin + 2;
+        labelLength[labelCount] = length;
+        labelCount++;
+        begin += 2 + length * 2;
+    }
+
+    // Walk the trie from the top level label down
+    uint32_t node = 0;
+    for(int i = labelCount - 1; i >= 0; i--) {
+        const SuffixNode& current = nodes[node];
+        if(current.firstEdge > edgeCount || current.edgeCount > edgeCount - current.firstEdge) {
+            return 0;
+        }
+
+        int low = current.firstEdge;
+        int high = current.firstEdge + current.edgeCount - 1;
+        int found = -1;
+        while(low <= high) {
+            int middle = low + (high - low) / 2;
+            int result = compareLabel(hexData, labelStart[i], labelLength[i], edges[middle]);
+            if(result == 0) {
+                found = middle;
+                break;
+            }
+            if(result < 0) {
+                high = middle - 1;
+            }
+            else {
+                low = middle + 1;
+            }
+        }
+
+        if(found < 0 || edges[found].child >= nodeCount) {
+            return 0;
+        }
+
+        node = edges[found].child;
+        if(nodes[node].terminal) {
+            return labelCount - i;
+        }
+    }
+
+    return 0;
+}
+
+// Compares a hex encoded label (case insensitive) with the label of an edge
+int SuffixMatcher::compareLabel(const string& hexData, int begin, unsigned int length, const SuffixEdge& edge) const {
+    if(edge.labelOffset > labelBytes || edge.labelLength > labelBytes - edge.labelOffset) {
+        return -1;
+    }
+
+    const unsigned char* edgeLabel = labels + edge.labelOffset;
+    unsigned int shortest = min(length, edge.labelLength);
+
+    for(unsigned int i = 0; i < shortest; i++) {
+        int labelChar = hexByte(hexData, begin + i * 2);
+        if(labelChar >= 'A' && labelChar <= 'Z') {
+            labelChar += 'a' - 'A';
+        }
+        if(labelChar != edgeLabel[i]) {
+            return labelChar < edgeLabel[i] ? -1 : 1;
+        }
+    }
+
+    if(length == edge.labelLength) {
+        return 0;
+    }
+    return length < edge.labelLength ? -1 : 1;
+}
+
+// Points the lookup tables into an image after checking its header
+bool SuffixMatcher::attachImage(const unsigned char* image, size_t size) {
+    SuffixImageHeader header;
+
+    if(size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, image, sizeof(header));
+
+    if(memcmp(header.magic, suffixImageMagic, sizeof(suffixImageMagic)) != 0 || header.nodeCount == 0) {
+        return false;
+    }
+
+    size_t expectedSize = sizeof(header) + (size_t)header.nodeCount * sizeof(SuffixNode) +
+                          (size_t)header.edgeCount * sizeof(SuffixEdge) + header.labelBytes;
+    if(expectedSize > size) {
+        return false;
+    }
+
+    nodes = reinterpret_cast<const SuffixNode*>(image + sizeof(header));
+    edges = reinterpret_cast<const SuffixEdge*>(image + sizeof(header) + (size_t)header.nodeCount * sizeof(SuffixNode));
+    labels = image + sizeof(header) + (size_t)header.nodeCount * sizeof(SuffixNode) + (size_t)header.edgeCount * sizeof(SuffixEdge);
+    nodeCount = header.nodeCount;
+    edgeCount = header.edgeCount;
+    labelBytes = header.labelBytes;
+
+    return true;
+}
+
+// Reads a list of domains and lays them out as a reversed-label trie image
+// Blank lines, "#" comments, leading "*." and trailing dots are ignored
+bool SuffixMatcher::buildImage(const string& listPath, vector<unsigned char>& image, unsigned long& entries) {
+    // Separates labels of a reversed name - sorts before every valid label character
+    const char labelSeparator = '\x01';
+    const int maxNameLength = 253;
+    const int maxLabelLength = 63;
+
+    ifstream listFile(listPath);
+    if(!listFile) {
+        return false;
+    }
+
+    vector<string> reversedNames;
+    string line;
+    while(getline(listFile, line)) {
+        line = line.substr(0, line.find('#'));
+        line.erase(remove_if(line.begin(), line.end(), ::isspace), line.end());
+        if(line.compare(0, 2, "*.") == 0) {
+            line.erase(0, 2);
+        }
+        while(!line.empty() && line.back() == '.') {
+            line.pop_back();
+        }
+        if(line.empty() || line.length() > maxNameLength) {
+            continue;
+        }
+        if(find_if(line.begin(), line.end(), [](char c) { return static_cast<unsigned char>(c) <= ' '; }) != line.end()) {
+            continue;
+        }
+        transform(line.begin(), line.end(), line.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+
+        // Reverse label order ("www.example.com" -> "com example www")
+        string reversed = string();
+        bool validName = true;
+        size_t end = line.length();
+        while(true) {
+            if(end == 0) {
+                validName = false;
+                break;
+            }
+            size_t dot = line.rfind('.', end - 1);
+            size_t start = (dot == string::npos) ? 0 : dot + 1;
+            if(end == start || end - start > maxLabelLength) {
+                validName = false;
+                break;
+            }
+            if(!reversed.empty()) {
+                reversed += labelSeparator;
+            }
+            reversed.append(line, start, end - start);
+            if(dot == string::npos) {
+                break;
+            }
+            end = dot;
+        }
+        if(validName) {
+            reversedNames.push_back(reversed);
+        }
+    }
+
+    sort(reversedNames.begin(), reversedNames.end());
+    reversedNames.erase(unique(reversedNames.begin(), reversedNames.end()), reversedNames.end());
+
+    // Build the trie in memory - sorted input keeps each node's children sorted
+    struct BuildNode {
+        vector<pair<string, uint32_t>> children;
+        bool terminal;
+    };
+    vector<BuildNode> buildNodes(1);
+    buildNodes[0].terminal = false;
+    entries = 0;
+
+    for(int i = 0; cmp_less(i, reversedNames.size()); i++) {
+        const string& name = reversedNames[i];
+        uint32_t node = 0;
+        size_t start = 0;
+        bool covered = false;
+
+        while(start <= name.length()) {
+            size_t end = name.find(labelSeparator, start);
+            if(end == string::npos) {
+                end = name.length();
+            }
+            string label = name.substr(start, end - start);
+
+            vector<pair<string, uint32_t>>& children = buildNodes[node].children;
+            if(!children.empty() && children.back().first == label) {
+                node = children.back().second;
+            }
+            else {
+                uint32_t child = buildNodes.size();
+                children.push_back({label, child});
+                buildNodes.push_back({{}, false});
+                node = child;
+            }
+
+            // Names below an existing entry are already matched by it
+            if(buildNodes[node].terminal) {
+                covered = true;
+                break;
+            }
+            start = end + 1;
+        }
+
+        if(!covered) {
+            buildNodes[node].terminal = true;
+            entries++;
+        }
+    }
+
+    // Lay out nodes breadth first so every node's edges are contiguous
+    vector<uint32_t> order;
+    vector<uint32_t> position(buildNodes.size());
+    order.reserve(buildNodes.size());
+    order.push_back(0);
+    for(int i = 0; cmp_less(i, order.size()); i++) {
+        position[order[i]] = i;
+        for(int j = 0; cmp_less(j, buildNodes[order[i]].children.size()); j++) {
+            order.push_back(buildNodes[order[i]].children[j].second);
+        }
+    }
+
+    vector<SuffixNode> imageNodes(order.size());
+    vector<SuffixEdge> imageEdges;
+    string labelPool = string();
+    unordered_map<string, uint32_t> labelOffsets;
+    imageEdges.reserve(order.size());
+
+    for(int i = 0; cmp_less(i, order.size()); i++) {
+        BuildNode& node = buildNodes[order[i]];
+        imageNodes[i].firstEdge = imageEdges.size();
+        imageNodes[i].edgeCount = node.children.size();
+        imageNodes[i].terminal = node.terminal ? 1 : 0;
+
+        for(int j = 0; cmp_less(j, node.children.size()); j++) {
+            const string& label = node.children[j].first;
+            auto pooled = labelOffsets.find(label);
+            uint32_t offset;
+            if(pooled == labelOffsets.end()) {
+                offset = labelPool.length();
+                labelPool.append(label);
+                labelOffsets[label] = offset;
+            }
+            else {
+                offset = pooled->second;
+            }
+            imageEdges.push_back({offset, (uint32_t)label.length(), position[node.children[j].second]});
+        }
+    }
+
+    SuffixImageHeader header;
+    memcpy(header.magic, suffixImageMagic, sizeof(suffixImageMagic));
+    header.nodeCount = imageNodes.size();
+    header.edgeCount = imageEdges.size();
+    header.labelBytes = labelPool.length();
+    header.entryCount = entries;
+
+    image.resize(sizeof(header) + imageNodes.size() * sizeof(SuffixNode) +
+                 imageEdges.size() * sizeof(SuffixEdge) + labelPool.length());
+    unsigned char* output = image.data();
+    memcpy(output, &header, sizeof(header));
+    output += sizeof(header);
+    memcpy(output, imageNodes.data(), imageNodes.size() * sizeof(SuffixNode));
+    output += imageNodes.size() * sizeof(SuffixNode);
+    memcpy(output, imageEdges.data(), imageEdges.size() * sizeof(SuffixEdge));
+    output += imageEdges.size() * sizeof(SuffixEdge);
+    memcpy(output, labelPool.data(), labelPool.length());
+
+    return true;
+}
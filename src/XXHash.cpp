@@ -0,0 +1,96 @@
+#include <cstring>
+#include <XXHash.hpp>
+
+using namespace std;
+
+// Constants of the 64 bit xxHash algorithm
+static const uint64_t hashPrime1 = 11400714785074694791ULL;
+static const uint64_t hashPrime2 = 14029467366897019727ULL;
+static const uint64_t hashPrime3 = 1609587929392839161ULL;
+static const uint64_t hashPrime4 = 9650029242287828579ULL;
+static const uint64_t hashPrime5 = 2870177450012600261ULL;
+
+static inline uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t hashRound(uint64_t accumulator, uint64_t input) {
+    accumulator += input * hashPrime2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * hashPrime1;
+}
+
+static inline uint64_t hashMerge(uint64_t accumulator, uint64_t value) {
+    accumulator ^= hashRound(0, value);
+    return accumulator * hashPrime1 + hashPrime4;
+}
+
+static inline uint64_t read64(const unsigned char* data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+// Hashes the bytes of data with the 64 bit xxHash algorithm (seed 0)
+uint64_t xxHash64(const string& key) {
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(key.data());
+    const unsigned char* end = data + key.length();
+    uint64_t hash;
+
+    if(key.length() >= 32) {
+        uint64_t lane1 = hashPrime1 + hashPrime2;
+        uint64_t lane2 = hashPrime2;
+        uint64_t lane3 = 0;
+        uint64_t lane4 = 0 - hashPrime1;
+
+        while(data + 32 <= end) {
+            lane1 = hashRound(lane1, read64(data));
+            lane2 = hashRound(lane2, read64(data + 8));
+            lane3 = hashRound(lane3, read64(data + 16));
+            lane4 = hashRound(lane4, read64(data + 24));
+            data += 32;
+        }
+
+        hash = rotateLeft(lane1, 1) + rotateLeft(lane2, 7) + rotateLeft(lane3, 12) + rotateLeft(lane4, 18);
+        hash = hashMerge(hash, lane1);
+        hash = hashMerge(hash, lane2);
+        hash = hashMerge(hash, lane3);
+        hash = hashMerge(hash, lane4);
+    }
+    else {
+        hash = hashPrime5;
+    }
+
+    hash += key.length();
+
+    while(data + 8 <= end) {
+        hash ^= hashRound(0, read64(data));
+        hash = rotateLeft(hash, 27) * hashPrime1 + hashPrime4;
+        data += 8;
+    }
+    if(data + 4 <= end) {
+        hash ^= read32(data) * hashPrime1;
+        hash = rotateLeft(hash, 23) * hashPrime2 + hashPrime3;
+        data += 4;
+    }
+    while(data < end) {
+        hash ^= (*data) * hashPrime5;
+        hash = rotateLeft(hash, 11) * hashPrime1;
+        data++;
+    }
+
+    // Final avalanche
+    hash ^= hash >> 33;
+    hash *= hashPrime2;
+    hash ^= hash >> 29;
+    hash *= hashPrime3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
@@ -1,26 +1,582 @@
 #include <string>
 #include <iostream>
+#include <algorithm>
 #include <DNSMessage.hpp>
+#include <DNSFilter.hpp>
+#include <SuffixMatcher.hpp>
+#include <MessageCache.hpp>
+#include <QueryCorrelator.hpp>
+#include <RecordStore.hpp>
+#include <memory>
+#include <chrono>
+#include <iomanip>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <utility>
+#include <InputDecoder.hpp>
+#include <MappedFile.hpp>
+#include <DnstapReader.hpp>
 
 using namespace std;
 
-int main() {
+// Totals collected over every message read from the input
+struct ParseStats {
+    unsigned long messages;
+    unsigned long printed;
+    unsigned long filtered;
+    unsigned long skippedBytes;
+    unsigned long stored;
+};
+
+// State shared by every message of the input
+struct ParseContext {
+    DNSParseOptions options;
+    ParseStats stats;
+    QueryCorrelator* correlator;
+    RecordStore* store;
+    uint64_t lastTime;
+};
+
+// Returns the current time in nanoseconds, used when the input carries no timestamps
+uint64_t currentTime() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Returns the wall clock time in nanoseconds since the epoch, used to timestamp stored records
+uint64_t wallClockTime() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Formats a timestamp in nanoseconds since the epoch as UTC ISO 8601
+string formatTimestamp(uint64_t timestamp) {
+    time_t seconds = timestamp / 1000000000;
+    char buffer[32];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", gmtime(&seconds));
+
+    string nanoseconds = to_string(timestamp % 1000000000);
+    return string(buffer) + "." + string(9 - nanoseconds.length(), '0') + nanoseconds + "Z";
+}
+
+// Where and when a message was captured - text input only knows when it was read
+struct MessageSource {
+    string client;
+    unsigned int port;
+    uint64_t time;
+    uint64_t timestamp;
+
+    // Printed before the message, e.g. the dnstap message type and addresses
+    string description;
+};
+
+// Correlates, stores or prints a parsed message unless it was rejected by the filter
+void processMessage(DNSMessage& decodedData, MessageSource& source, ParseContext& context) {
+    CorrelatedPair pair;
+    bool correlated = false;
+
+    context.stats.messages++;
+    context.lastTime = source.time;
+
+    if(context.correlator) {
+        correlated = context.correlator->observe(decodedData, source.client, source.port, source.time, pair);
+    }
+
+    if(decodedData.isFiltered()) {
+        context.stats.filtered++;
+        context.stats.skippedBytes += decodedData.getSkippedBytes();
+        return;
+    }
+
+    // Storing replaces the text output
+    if(context.store) {
+        if(context.store->append(decodedData, source.timestamp)) {
+            context.stats.stored++;
+        }
+        return;
+    }
+
+    if(context.stats.printed++) {
+        cout << endl;
+    }
+    if(!source.description.empty()) {
+        cout << source.description << endl;
+    }
+    decodedData.printData();
+
+    if(correlated) {
+        cout << endl << ";; LATENCY: " << fixed << setprecision(3) << pair.latency / 1e6 << " ms" << endl;
+    }
+}
+
+// Parses a single message read from text or binary input
+void handleMessage(string& rawDns, ParseContext& context) {
+    DNSMessage decodedData(rawDns, context.options);
+    MessageSource source = {string(), 0, currentTime(), wallClockTime(), string()};
+    processMessage(decodedData, source, context);
+}
+
+// Prints the totals collected by the correlator
+void printCorrelationStats(QueryCorrelator& correlator) {
+    CorrelationStats stats = correlator.getStats();
+
+    cout << ";; CORRELATION: queries: " << stats.queries;
+    cout << ", responses: " << stats.responses;
+    cout << ", matched: " << stats.matched;
+    cout << ", timeouts: " << stats.timeouts;
+    cout << ", timeout rate: " << fixed << setprecision(2) << (stats.queries ? stats.timeouts * 100.0 / stats.queries : 0.0) << "%";
+    cout << ", unanswered: " << stats.outstanding;
+    cout << ", unmatched responses: " << stats.unmatched;
+    cout << ", dropped: " << stats.dropped << endl;
+
+    cout << ";; LATENCY: p50: " << setprecision(3) << stats.latencies.percentile(50) / 1e6 << " ms";
+    cout << ", p90: " << stats.latencies.percentile(90) / 1e6 << " ms";
+    cout << ", p99: " << stats.latencies.percentile(99) / 1e6 << " ms";
+    cout << ", mean: " << stats.latencies.getMean() / 1e6 << " ms";
+    cout << ", max: " << stats.latencies.getMax() / 1e6 << " ms" << endl;
+}
+
+// Prints the totals collected while parsing
+void printStats(ParseContext& context, MessageCache* cache) {
+    ParseStats& stats = context.stats;
+
+    cout << endl << ";; STATS: messages: " << stats.messages;
+    cout << ", printed: " << stats.printed;
+    if(context.store) {
+        cout << ", stored: " << stats.stored;
+    }
+    cout << ", filtered: " << stats.filtered;
+    cout << ", skipped bytes: " << stats.skippedBytes << endl;
+
+    if(cache) {
+        unsigned long lookups = cache->getHits() + cache->getMisses();
+        cout << ";; CACHE: hits: " << cache->getHits();
+        cout << ", misses: " << cache->getMisses();
+        cout << ", hit rate: " << (lookups ? cache->getHits() * 100 / lookups : 0) << "%";
+        cout << ", evictions: " << cache->getEvictions();
+        cout << ", entries: " << cache->getEntries();
+        cout << ", bytes: " << cache->getBytes() << "/" << cache->getMaxBytes() << endl;
+    }
+}
+
+// Prints a record read back from a record store
+void printStoredRecord(StoredRecord& record) {
+    vector<ResourceRecord>* sections[3] = {&record.answers, &record.authority, &record.additional};
+    vector<string> flagNames = {"qr", "aa", "tc", "rd", "ra"};
+    unsigned int flagValues[5] = {record.headerFlags.QR, record.headerFlags.AA, record.headerFlags.TC,
+                                  record.headerFlags.RD, record.headerFlags.RA};
+
+    cout << ";; time: " << formatTimestamp(record.timestamp) << ", id: " << record.dnsID << ", flags:";
+    for(int i = 0; i < 5; i++) {
+        if(flagValues[i]) {
+            cout << " " << flagNames[i];
+        }
+    }
+    cout << ", status: " << DNSMessage::rcodeName(record.headerFlags.RCODE) << endl;
+
+    for(int i = 0; cmp_less(i, record.questions.size()); i++) {
+        cout << ";" << record.questions[i].qName << "\t\t" << DNSMessage::className(record.questions[i].qClass);
+        cout << "\t" << DNSMessage::typeName(record.questions[i].qType) << endl;
+    }
+    for(int count = 0; count < 3; count++) {
+        for(int i = 0; cmp_less(i, sections[count]->size()); i++) {
+            cout << DNSMessage::printableRecord((*sections[count])[i]);
+        }
+    }
+}
+
+// Prints every stored record containing the name (or, for suffix lookups, a name below it)
+int queryStore(const string& path, const string& name, bool suffix) {
+    RecordStoreReader reader;
+    vector<StoredRecord> results;
+
+    if(!reader.open(path)) {
+        cout << "Error: Unable to open record store '" << path << "'." << endl;
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    reader.find(name, suffix, results);
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    for(int i = 0; cmp_less(i, results.size()); i++) {
+        printStoredRecord(results[i]);
+        cout << endl;
+    }
+    cout << ";; " << results.size() << " records found in " << fixed << setprecision(3) << elapsed << " ms" << endl;
+    return 0;
+}
+
+// Reads a byte count with an optional K, M or G suffix - returns 0 if it is invalid
+size_t parseByteCount(string value) {
+    size_t multiplier = 1;
+    if(!value.empty()) {
+        char suffix = toupper(value.back());
+        if(suffix == 'K' || suffix == 'M' || suffix == 'G') {
+            multiplier = (suffix == 'K') ? 1024 : (suffix == 'M') ? 1024 * 1024 : 1024 * 1024 * 1024;
+            value.pop_back();
+        }
+    }
+
+    size_t length = 0;
+    try {
+        unsigned long long count = stoull(value, &length, 10);
+        return (length == value.length()) ? count * multiplier : 0;
+    }
+    catch(...) {
+        return 0;
+    }
+}
+
+// Reads wire format messages, each prefixed by its length as a 16 bit big endian value
+void readBinaryMessages(const unsigned char* data, size_t size, ParseContext& context) {
+    size_t offset = 0;
+
+    while(offset + 2 <= size) {
+        size_t length = (data[offset] << 8) | data[offset + 1];
+        offset += 2;
+        if(offset + length > size) {
+            cout << "Error: Binary input ends inside a message of " << length << " bytes." << endl;
+            return;
+        }
+
+        DNSMessage decodedData(data + offset, length, context.options);
+        MessageSource source = {string(), 0, currentTime(), wallClockTime(), string()};
+        processMessage(decodedData, source, context);
+        offset += length;
+    }
+}
+
+// Reads the next line, starting with the bytes peeked from the stream for format detection
+bool readLine(istream& input, string& peeked, string& line) {
+    size_t lineEnd = peeked.find('\n');
+    if(lineEnd != string::npos) {
+        line = peeked.substr(0, lineEnd);
+        peeked.erase(0, lineEnd + 1);
+        return true;
+    }
+
+    string rest;
+    if(!getline(input, rest) && peeked.empty()) {
+        return false;
+    }
+    line = peeked + rest;
+    peeked.clear();
+    return true;
+}
+
+// Reads text messages - hex messages end at an empty line, base64 messages at the end of their line
+// The format is detected once per stream, from the first bytes already buffered or else its first line with content
+void readMessages(istream& input, ParseContext& context) {
+    const streamsize binaryProbe = 512;
+    inputFormat& format = context.options.format;
     string rawDns;
     string line;
-    
-    cout << "Please enter hex encoded DNS string. Type 'exit' to complete input:" << endl;
+    string peeked;
+
+    // Length prefixes of binary input may contain line breaks, so the raw bytes are checked before splitting lines
+    // Only bytes that have already arrived are peeked, which keeps an interactive terminal responsive
+    if(format == FORMAT_AUTO && input.peek() != EOF) {
+        peeked.resize(binaryProbe);
+        peeked.resize(input.readsome(peeked.data(), binaryProbe));
+        if(peeked.find_first_not_of(" \t\r\n") != string::npos) {
+            format = detectFormat(peeked.data(), peeked.length());
+        }
+    }
+
+    // Binary input is read whole
+    if(format == FORMAT_RAW_BINARY) {
+        peeked.append(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+        readBinaryMessages(reinterpret_cast<const unsigned char*>(peeked.data()), peeked.size(), context);
+        return;
+    }
+
+    bool firstLine = true;
+
+    while(readLine(input, peeked, line)) {
+        // A byte order mark at the start of a text file is not part of the first message
+        if(firstLine && line.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+            line.erase(0, 3);
+        }
+        firstLine = false;
+
+        if(format == FORMAT_AUTO && line.find_first_not_of(" \t\r") != string::npos) {
+            format = detectFormat(line.data(), line.length());
+        }
+
+        // Binary input is read whole, restoring the line break consumed while reading the line
+        if(format == FORMAT_RAW_BINARY) {
+            string data = line;
+            if(!input.eof()) {
+                data += '\n';
+            }
+            data.append(peeked);
+            data.append(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+            readBinaryMessages(reinterpret_cast<const unsigned char*>(data.data()), data.size(), context);
+            return;
+        }
 
-    while(getline(cin, line)) {
         line.erase(remove(line.begin(), line.end(), '\n'), line.end());
+        line.erase(remove(line.begin(), line.end(), '\r'), line.end());
         if(line == "exit") {
             break;
         }
 
+        if(format == FORMAT_BASE64) {
+            if(!line.empty()) {
+                handleMessage(line, context);
+            }
+            continue;
+        }
+
+        // An empty line completes the current message
+        if(line.empty()) {
+            if(!rawDns.empty()) {
+                handleMessage(rawDns, context);
+                rawDns.clear();
+            }
+            continue;
+        }
+
         rawDns.append(line);
     }
 
-    DNSMessage decodedData(rawDns);
-    decodedData.printData();
-    
-    return 0;
-}
\ No newline at end of file
+    if(!rawDns.empty() || context.stats.messages == 0) {
+        handleMessage(rawDns, context);
+    }
+}
+
+// Parses the DNS message of every dnstap message - queries are read from the query message
+// and responses from the response message, both straight from the frame
+bool readDnstap(DnstapReader& reader, ParseContext& context) {
+    DnstapMessage message;
+
+    while(reader.next(message)) {
+        bool response = (message.type % 2 == 0);
+        const unsigned char* wireData = response ? message.responseMessage : message.queryMessage;
+        size_t length = response ? message.responseLength : message.queryLength;
+        if(!wireData) {
+            continue;
+        }
+
+        MessageSource source = {message.queryAddress, message.queryPort, 0, 0, string()};
+        source.time = response ? message.responseTime : message.queryTime;
+        source.timestamp = source.time;
+
+        string protocol = DnstapReader::protocolName(message.socketProtocol);
+        source.description = ";; DNSTAP: " + DnstapReader::typeName(message.type) + " " +
+                             message.queryAddress + "#" + to_string(message.queryPort) + " -> " +
+                             message.responseAddress + "#" + to_string(message.responsePort) +
+                             (protocol.empty() ? "" : " " + protocol) + " " + formatTimestamp(source.time);
+
+        DNSMessage decodedData(wireData, length, context.options);
+        processMessage(decodedData, source, context);
+    }
+
+    if(reader.getError() != DNSTAP_VALID) {
+        cout << "Error: Invalid dnstap stream after " << reader.getFrames() << " frames." << endl;
+        return false;
+    }
+    return true;
+}
+
+// Reads messages from a file - binary files are parsed straight from the mapped file
+bool readFile(const string& path, ParseContext& context) {
+    MappedFile file;
+    if(!file.open(path)) {
+        return false;
+    }
+
+    inputFormat& format = context.options.format;
+    if(format == FORMAT_AUTO) {
+        format = detectFormat(reinterpret_cast<const char*>(file.data()), file.size());
+    }
+    if(format == FORMAT_RAW_BINARY) {
+        readBinaryMessages(file.data(), file.size(), context);
+        return true;
+    }
+    file.close();
+
+    ifstream input(path, ios::binary);
+    if(!input) {
+        return false;
+    }
+    readMessages(input, context);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // Unsynced standard input buffers what has arrived, which lets readMessages peek at it without blocking
+    ios::sync_with_stdio(false);
+
+    string inputPath;
+    string dnstapPath;
+    string dnstapSocket;
+    DnstapReader dnstap;
+    bool dnstapValid = true;
+    DNSFilter filter;
+    SuffixMatcher matcher;
+    unique_ptr<MessageCache> cache;
+    unique_ptr<QueryCorrelator> correlator;
+    RecordStore store;
+    ParseContext context = {};
+    DNSParseOptions& options = context.options;
+    bool showStats = false;
+    bool correlate = false;
+    unsigned long timeout = 5000;
+    unsigned long maxOutstanding = 1000000;
+
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--filter" && i + 1 < argc) {
+            if(filter.compile(argv[++i]) != FILTER_VALID) {
+                cout << "Error: Invalid filter expression '" << argv[i] << "'." << endl;
+                return 1;
+            }
+            options.filter = &filter;
+        }
+        else if(arg == "--match-list" && i + 1 < argc) {
+            if(!matcher.load(argv[++i])) {
+                cout << "Error: Unable to load suffix list '" << argv[i] << "'." << endl;
+                return 1;
+            }
+            options.matcher = &matcher;
+        }
+        else if(arg == "--compile-list" && i + 2 < argc) {
+            unsigned long entries = 0;
+            if(!SuffixMatcher::compileList(argv[i + 1], argv[i + 2], entries)) {
+                cout << "Error: Unable to compile suffix list '" << argv[i + 1] << "'." << endl;
+                return 1;
+            }
+            cout << "Compiled " << entries << " entries into '" << argv[i + 2] << "'." << endl;
+            return 0;
+        }
+        else if(arg == "--cache" && i + 1 < argc) {
+            size_t cacheBytes = parseByteCount(argv[++i]);
+            if(cacheBytes == 0) {
+                cout << "Error: Invalid cache size '" << argv[i] << "'." << endl;
+                return 1;
+            }
+            if(cacheBytes < MessageCache::minBytes) {
+                cout << "Error: Cache size '" << argv[i] << "' is below the minimum of " << MessageCache::minBytes / 1024 << "K." << endl;
+                return 1;
+            }
+            cache = make_unique<MessageCache>(cacheBytes);
+            options.cache = cache.get();
+        }
+        else if(arg == "--correlate") {
+            correlate = true;
+        }
+        else if(arg == "--timeout" && i + 1 < argc) {
+            timeout = strtoul(argv[++i], nullptr, 10);
+            if(timeout == 0) {
+                cout << "Error: Invalid timeout '" << argv[i] << "'." << endl;
+                return 1;
+            }
+        }
+        else if(arg == "--max-outstanding" && i + 1 < argc) {
+            maxOutstanding = strtoul(argv[++i], nullptr, 10);
+            if(maxOutstanding == 0) {
+                cout << "Error: Invalid outstanding query limit '" << argv[i] << "'." << endl;
+                return 1;
+            }
+        }
+        else if(arg == "--store" && i + 1 < argc) {
+            if(!store.open(argv[++i])) {
+                cout << "Error: Unable to open record store '" << argv[i] << "'." << endl;
+                return 1;
+            }
+            context.store = &store;
+        }
+        else if((arg == "--query" || arg == "--query-suffix") && i + 2 < argc) {
+            return queryStore(argv[i + 1], argv[i + 2], arg == "--query-suffix");
+        }
+        else if(arg == "--format" && i + 1 < argc) {
+            bool valid = false;
+            options.format = parseFormatName(argv[++i], valid);
+            if(!valid) {
+                cout << "Error: Unknown input format '" << argv[i] << "'." << endl;
+                return 1;
+            }
+        }
+        else if(arg == "--input" && i + 1 < argc) {
+            inputPath = argv[++i];
+        }
+        else if(arg == "--dnstap" && i + 1 < argc) {
+            dnstapPath = argv[++i];
+        }
+        else if(arg == "--dnstap-socket" && i + 1 < argc) {
+            dnstapSocket = argv[++i];
+        }
+        else if(arg == "--dnstap-replay" && i + 2 < argc) {
+            unsigned long frames = 0;
+            if(!DnstapReader::replay(argv[i + 1], argv[i + 2], frames)) {
+                cout << "Error: Unable to replay '" << argv[i + 1] << "' to '" << argv[i + 2] << "'." << endl;
+                return 1;
+            }
+            cout << "Replayed " << frames << " frames to '" << argv[i + 2] << "'." << endl;
+            return 0;
+        }
+        else if(arg == "--stats") {
+            showStats = true;
+        }
+        else {
+            cout << "Usage: " << argv[0] << " [--filter EXPRESSION] [--match-list FILE] [--cache BYTES]" << endl;
+            cout << "       " << string(string(argv[0]).length(), ' ') << " [--correlate [--timeout MS] [--max-outstanding N]]" << endl;
+            cout << "       " << string(string(argv[0]).length(), ' ') << " [--store FILE] [--stats]" << endl;
+            cout << "       " << string(string(argv[0]).length(), ' ') << " [--format auto|escaped|hex|base64|raw] [--input FILE]" << endl;
+            cout << "       " << string(string(argv[0]).length(), ' ') << " [--dnstap FILE | --dnstap-socket PATH]" << endl;
+            cout << "       " << argv[0] << " --dnstap-replay FILE PATH" << endl;
+            cout << "       " << argv[0] << " --compile-list LIST IMAGE" << endl;
+            cout << "       " << argv[0] << " --query|--query-suffix FILE NAME" << endl;
+            return 1;
+        }
+    }
+
+    // Only a detected hex format may be mixed with the other hex format, a given format is enforced
+    options.mixedFormats = (options.format == FORMAT_AUTO);
+
+    if(correlate) {
+        // Timeout is given in milliseconds, the correlator works in nanoseconds
+        correlator = make_unique<QueryCorrelator>((uint64_t)timeout * 1000000, maxOutstanding);
+        context.correlator = correlator.get();
+        options.alwaysParseQuestions = true;
+    }
+
+    if(!dnstapPath.empty() || !dnstapSocket.empty()) {
+        bool opened = dnstapPath.empty() ? dnstap.listen(dnstapSocket) : dnstap.openFile(dnstapPath);
+        if(!opened) {
+            cout << "Error: Unable to open dnstap input '" << (dnstapPath.empty() ? dnstapSocket : dnstapPath) << "'." << endl;
+            return 1;
+        }
+        dnstapValid = readDnstap(dnstap, context);
+        dnstap.close();
+    }
+    else if(!inputPath.empty()) {
+        if(!readFile(inputPath, context)) {
+            cout << "Error: Unable to read input file '" << inputPath << "'." << endl;
+            return 1;
+        }
+    }
+    else {
+        cout << "Please enter hex encoded DNS string. Separate messages with an empty line. Type 'exit' to complete input:" << endl;
+        readMessages(cin, context);
+    }
+
+    if(showStats) {
+        printStats(context, cache.get());
+    }
+    if(correlator) {
+        if(!showStats) {
+            cout << endl;
+        }
+        correlator->advance(context.lastTime);
+        printCorrelationStats(*correlator);
+    }
+
+    if(context.store && !store.close()) {
+        cout << "Error: Unable to write record store index." << endl;
+        return 1;
+    }
+
+    return dnstapValid ? 0 : 1;
+}